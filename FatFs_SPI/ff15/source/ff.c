@@ -471,7 +471,8 @@ static BYTE CurrVol;				/* Current drive set by f_chdrive() */
 #if FF_FS_LOCK != 0
 static FILESEM Files[FF_FS_LOCK];	/* Open object lock semaphores */
 #if FF_FS_REENTRANT
-static BYTE SysLock;				/* System lock flag (0:no mutex, 1:unlocked, 2:locked) */
+static BYTE SysLock;				/* System lock flag (0:no mutex, 1:ready) */
+static BYTE SysLocked[FF_VOLUMES];	/* System lock taken in a function on the volume (guarded by the volume mutex) */
 #endif
 #endif
 
@@ -510,6 +511,9 @@ static const BYTE GUID_MS_Basic[16] = {0xA2,0xA0,0xD0,0xEB,0xE5,0xB9,0x33,0x44,0
 #if FF_LFN_BUF < FF_SFN_BUF || FF_SFN_BUF < 12
 #error Wrong setting of FF_LFN_BUF or FF_SFN_BUF
 #endif
+#if FF_LFN_BUF_POOL && FF_USE_LFN != 3
+#error FF_LFN_BUF_POOL needs FF_USE_LFN == 3
+#endif
 #if FF_LFN_UNICODE < 0 || FF_LFN_UNICODE > 3
 #error Wrong setting of FF_LFN_UNICODE
 #endif
@@ -557,6 +561,13 @@ static WCHAR LfnBuf[FF_MAX_LFN + 1];		/* LFN working buffer */
 #endif	/* FF_USE_LFN == 1 */
 #endif	/* FF_USE_LFN == 0 */
 
+#if FF_DIR_INDEX && FF_USE_LFN != 3
+#error FF_DIR_INDEX needs FF_USE_LFN == 3
+#endif
+#if FF_DIR_INDEX && FF_DIR_INDEX_MAX_KEYS < 1
+#error Wrong setting of FF_DIR_INDEX_MAX_KEYS
+#endif
+
 
 
 /*--------------------------------*/
@@ -905,7 +916,7 @@ static int lock_volume (	/* 1:Ok, 0:timeout */
 	if (rv && syslock) {			/* System lock reqiered? */
 		rv = ff_mutex_take(FF_VOLUMES);	/* Lock the system */
 		if (rv) {
-			SysLock = 2;				/* System lock succeeded */
+			SysLocked[fs->ldrv] = 1;	/* System lock succeeded */
 		} else {
 			ff_mutex_give(fs->ldrv);	/* Failed system lock */
 		}
@@ -924,8 +935,8 @@ static void unlock_volume (
 {
 	if (fs && res != FR_NOT_ENABLED && res != FR_INVALID_DRIVE && res != FR_TIMEOUT) {
 #if FF_FS_LOCK
-		if (SysLock == 2) {	/* Is the system locked? */
-			SysLock = 1;
+		if (SysLocked[fs->ldrv]) {	/* Is the system locked by this volume? (another volume may hold it) */
+			SysLocked[fs->ldrv] = 0;
 			ff_mutex_give(FF_VOLUMES);
 		}
 #endif
@@ -1033,6 +1044,24 @@ static FRESULT dec_share (	/* Decrement object open counter */
 }
 
 
+#if FF_FS_REENTRANT
+static FRESULT dec_share_sys (	/* dec_share() in functions that have not taken the system lock */
+	UINT i			/* Semaphore index (1..) */
+)
+{
+	FRESULT res;
+
+
+	if (!ff_mutex_take(FF_VOLUMES)) return FR_TIMEOUT;	/* Files[] is shared with other volumes */
+	res = dec_share(i);
+	ff_mutex_give(FF_VOLUMES);
+	return res;
+}
+#else
+#define dec_share_sys(i) dec_share(i)
+#endif
+
+
 static void clear_share (	/* Clear all lock entries of the volume */
 	FATFS* fs
 )
@@ -1232,6 +1261,54 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 
 
 #if !FF_FS_READONLY
+#if FF_FREEMAP_SIZE
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - a bit per group of clusters, set if all in use     */
+/*-----------------------------------------------------------------------*/
+
+static void fmap_init (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	BYTE sh = 0;
+
+
+	while (((fs->n_fatent - 1) >> sh) >= FF_FREEMAP_SIZE * 8) sh++;	/* Set group size to cover all clusters */
+	fs->fmap_shift = sh;
+	memset(fs->fmap, 0, sizeof fs->fmap);	/* Nothing is known to be in use yet */
+}
+
+
+static int fmap_full (	/* 0:Group may have free clusters, !=0:Group is in use */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* A cluster in the group */
+)
+{
+	DWORD g = clst >> fs->fmap_shift;
+
+
+	return fs->fmap[g / 8] & (1 << (g % 8));
+}
+
+
+static void fmap_mark (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* A cluster in the group */
+	int full		/* 0:Group may have free clusters, 1:Group is in use */
+)
+{
+	DWORD g = clst >> fs->fmap_shift;
+
+
+	if (full) {
+		fs->fmap[g / 8] |= (BYTE)(1 << (g % 8));
+	} else {
+		fs->fmap[g / 8] &= (BYTE)~(1 << (g % 8));
+	}
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Change value of an FAT entry                             */
 /*-----------------------------------------------------------------------*/
@@ -1248,6 +1325,9 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 
 
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
+#if FF_FREEMAP_SIZE
+		if (val == 0) fmap_mark(fs, clst, 0);	/* The group has a free cluster */
+#endif
 		switch (fs->fs_type) {
 		case FS_FAT12:
 			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
@@ -1584,6 +1664,10 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			}
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
+#if FF_FREEMAP_SIZE
+			DWORD gmask = ((DWORD)1 << fs->fmap_shift) - 1;	/* Cluster offset mask in a group */
+			int gtop = 0;	/* Has the current group been scanned from its top? */
+#endif
 			ncl = scl;	/* Start cluster */
 			for (;;) {
 				ncl++;							/* Next cluster */
@@ -1591,9 +1675,27 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 					ncl = 2;
 					if (ncl > scl) return 0;	/* No free cluster found? */
 				}
+#if FF_FREEMAP_SIZE
+				if ((ncl & gmask) == 0 || ncl == 2) {	/* Top of a group? */
+					if (fmap_full(fs, ncl)) {	/* Skip the group if it is known to be in use */
+						cs = ncl | gmask;		/* Last cluster in the group */
+						if (cs >= fs->n_fatent) cs = fs->n_fatent - 1;
+						if (scl >= ncl && scl <= cs) return 0;	/* No free cluster found? */
+						ncl = cs;
+						gtop = 0;
+						continue;
+					}
+					gtop = 1;
+				}
+#endif
 				cs = get_fat(obj, ncl);			/* Get the cluster status */
 				if (cs == 0) break;				/* Found a free cluster? */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+#if FF_FREEMAP_SIZE
+				if (gtop && ((ncl & gmask) == gmask || ncl == fs->n_fatent - 1)) {
+					fmap_mark(fs, ncl, 1);	/* The whole group was found in use */
+				}
+#endif
 				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
 		}
@@ -1650,6 +1752,75 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+#if FF_USE_EXTCACHE
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Extent cache                                           */
+/*-----------------------------------------------------------------------*/
+
+static DWORD xc_clust (	/* 0:Not in the cache, >=2:Cluster number */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD icl		/* Cluster offset from top of the file */
+)
+{
+	FXCACHE *xc = fp->xcache;
+	UINT lo, hi, i;
+
+
+	if (!xc || icl >= xc->ncl) return 0;
+	lo = 0; hi = xc->n - 1;
+	while (lo < hi) {		/* Find the last extent starting at or before icl */
+		i = (lo + hi + 1) / 2;
+		if (xc->ext[i].top <= icl) lo = i; else hi = i - 1;
+	}
+	return xc->ext[lo].clst + (icl - xc->ext[lo].top);
+}
+
+
+static void xc_note (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD icl,		/* Cluster offset from top of the file */
+	DWORD clst		/* Cluster found there by following the chain */
+)
+{
+	FXCACHE *xc = fp->xcache;
+	FEXT *last;
+
+
+	if (!xc || icl != xc->ncl) return;	/* Only the cluster following the covered part can be added */
+	if (xc->n > 0) {
+		last = &xc->ext[xc->n - 1];
+		if (clst == last->clst + (icl - last->top)) {	/* Contiguous with the last extent? */
+			xc->ncl++;
+			return;
+		}
+	}
+	if (xc->n < xc->size) {		/* Start a new extent if there is room */
+		xc->ext[xc->n].top = icl;
+		xc->ext[xc->n].clst = clst;
+		xc->n++;
+		xc->ncl++;
+	}
+}
+
+
+static void xc_trim (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ncl		/* Number of clusters left in the chain */
+)
+{
+	FXCACHE *xc = fp->xcache;
+
+
+	if (!xc || ncl >= xc->ncl) return;
+	xc->ncl = ncl;
+	while (xc->n > 0 && xc->ext[xc->n - 1].top >= ncl) xc->n--;
+}
+
+#endif	/* FF_USE_EXTCACHE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Fill a cluster with zeros                        */
 /*-----------------------------------------------------------------------*/
@@ -2377,44 +2548,208 @@ static FRESULT dir_read (
 
 
 
+#if FF_DIR_INDEX
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Find an object in the directory                  */
+/* Directory index - Name hashes of the entry blocks in a directory      */
 /*-----------------------------------------------------------------------*/
+/* Each key holds a name hash and the index of the first entry of the block
+/  (LFN entries and SFN entry, or exFAT entry set) holding the name. A name on
+/  the FAT volume gets a key for its SFN and another for its LFN if any. The
+/  keys cover the first 'end' entries of the directory, in order, and are added
+/  as dir_find() scans on from there. */
 
-static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+typedef struct {
+	BYTE ord, sum;	/* LFN sequence being checked */
+	DWORD blk;		/* Index of the top of the entry block (0xFFFFFFFF:none) */
+	DWORD lhash;	/* Hash of the LFN so far */
+} IDXSCAN;
+
+
+static DWORD idx_mix (DWORD x)	/* Scramble the bits of a value */
+{
+	x *= 0x9E3779B1; x ^= x >> 15;
+	x *= 0x85EBCA77; x ^= x >> 13;
+	return x;
+}
+
+
+static WORD idx_hash_sfn (const BYTE* sfn)	/* Hash of an SFN */
+{
+	DWORD h = 0;
+	UINT i;
+
+
+	for (i = 0; i < 11; i++) h = idx_mix(h + sfn[i]);
+	return (WORD)(h ^ h >> 16);
+}
+
+
+static DWORD idx_lfn_char (	/* Hash of a character of an LFN (summed up in any order) */
+	DWORD uc,	/* Character */
+	UINT i		/* Position in the LFN */
+)
+{
+	return idx_mix(ff_wtoupper(uc) | (DWORD)i << 21);
+}
+
+
+static WORD idx_hash_lfn (const WCHAR* lfn)	/* Hash of an LFN, ignoring case */
+{
+	DWORD h = 0;
+	UINT i;
+
+
+	for (i = 0; lfn[i]; i++) h += idx_lfn_char(lfn[i], i);
+	return (WORD)(h ^ h >> 16);
+}
+
+
+static void idx_clear (	/* Drop all indexes of the volume */
+	FATFS* fs
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_DIR_INDEX; i++) {
+		ff_memfree(fs->diridx[i].key);
+		memset(&fs->diridx[i], 0, sizeof (DIRIDX));
+	}
+}
+
+
+static DIRIDX* idx_get (	/* Get the index of the directory, starting one if needed (0:none) */
+	DIR* dp
 )
 {
-	FRESULT res;
 	FATFS *fs = dp->obj.fs;
-	BYTE c;
-#if FF_USE_LFN
-	BYTE a, ord, sum;
-#endif
+	DIRIDX *ix = 0, *lru = &fs->diridx[0];
+	UINT i;
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
-	if (res != FR_OK) return res;
-#if FF_FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
-		BYTE nc;
-		UINT di, ni;
-		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
 
-		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
-#if FF_MAX_LFN < 255
-			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;		/* Skip comparison if inaccessible object name */
+	for (i = 0; i < FF_DIR_INDEX && !ix; i++) {
+		if (fs->diridx[i].key && fs->diridx[i].sclust == dp->obj.sclust) ix = &fs->diridx[i];
+		else if (fs->idxuse - fs->diridx[i].use > fs->idxuse - lru->use) lru = &fs->diridx[i];
+	}
+	if (!ix) {	/* Replace the least recently used */
+		ix = lru;
+		ff_memfree(ix->key);
+		memset(ix, 0, sizeof (DIRIDX));
+		ix->szkey = FF_DIR_INDEX_MAX_KEYS < 64 ? FF_DIR_INDEX_MAX_KEYS : 64;
+		ix->key = ff_memalloc(ix->szkey * sizeof (DWORD));
+		if (!ix->key) return 0;
+		ix->sclust = dp->obj.sclust;
+	}
+	ix->use = ++fs->idxuse;
+	return ix;
+}
+
+
+static void idx_add (	/* Add a key at the end of the index */
+	DIRIDX* ix,
+	WORD hash,		/* Name hash */
+	DWORD blk		/* Index of the top of the entry block */
+)
+{
+	DWORD *nk;
+	UINT sz;
+
+
+	if (ix->nkey == ix->szkey) {	/* Grow the key array */
+		if (ix->szkey >= FF_DIR_INDEX_MAX_KEYS) { ix->stat |= 2; return; }	/* Full: stop here */
+		sz = ix->szkey * 2 < FF_DIR_INDEX_MAX_KEYS ? ix->szkey * 2 : FF_DIR_INDEX_MAX_KEYS;
+		nk = ff_memalloc(sz * sizeof (DWORD));
+		if (!nk) { ix->stat |= 2; return; }	/* Out of memory (if malloc can fail): stop here */
+		memcpy(nk, ix->key, ix->nkey * sizeof (DWORD));
+		ff_memfree(ix->key);
+		ix->key = nk;
+		ix->szkey = sz;
+	}
+	ix->key[ix->nkey++] = (DWORD)hash << 16 | blk;
+}
+
+
+static void idx_scan (	/* Add the entry being scanned to the index */
+	DIR* dp,
+	DIRIDX* ix,
+	IDXSCAN* is		/* Scan state */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DWORD ent = dp->dptr / SZDIRE;
+	BYTE c, a;
+	UINT i, s;
+	WCHAR uc;
+
+
+	/* The scan goes on entry by entry from where the index ends */
+	if (ix->stat & 2) return;	/* Cannot grow? */
+	if (ent >= 0xFFFF) { ix->stat |= 2; return; }	/* Beyond what a key can hold */
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* dp is at the last entry of a loaded entry set */
+		idx_add(ix, ld_word(fs->dirbuf + XDIR_NameHash), dp->blk_ofs / SZDIRE);
+		if (!(ix->stat & 2)) ix->end = ent + 1;
+		return;
+	}
 #endif
-			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
-			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
-				if ((di % SZDIRE) == 0) di += 2;
-				if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
+	c = dp->dir[DIR_Name];
+	a = dp->dir[DIR_Attr] & AM_MASK;
+	if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
+		is->ord = 0xFF; is->blk = 0xFFFFFFFF;
+	} else if (a == AM_LFN) {	/* An LFN entry: accumulate the hash of its part of the LFN */
+		if (c & LLEF) {
+			is->sum = dp->dir[LDIR_Chksum];
+			c &= (BYTE)~LLEF; is->ord = c;
+			is->blk = ent;
+			is->lhash = 0;
+		}
+		if (c == is->ord && is->sum == dp->dir[LDIR_Chksum] && ld_word(dp->dir + LDIR_FstClusLO) == 0) {
+			i = ((c & 0x3F) - 1) * 13;
+			for (s = 0; s < 13 && (uc = ld_word(dp->dir + LfnOfs[s])) != 0; s++, i++) {
+				is->lhash += idx_lfn_char(uc, i);
 			}
-			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
+			is->ord--;
+		} else {
+			is->ord = 0xFF;
 		}
-		return res;
+		return;	/* The index ends at the top of an entry block */
+	} else {	/* An SFN entry closes the entry block */
+		if (is->blk == 0xFFFFFFFF) is->blk = ent;
+		if (is->ord == 0 && is->sum == sum_sfn(dp->dir)) {	/* Valid LFN? */
+			idx_add(ix, (WORD)(is->lhash ^ is->lhash >> 16), is->blk);
+		}
+		idx_add(ix, idx_hash_sfn(dp->dir), is->blk);
+		is->ord = 0xFF; is->blk = 0xFFFFFFFF;
 	}
+	if (!(ix->stat & 2)) ix->end = ent + 1;
+}
+
 #endif
-	/* On the FAT/FAT32 volume */
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Find an object in the directory                  */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_find_fat (	/* FR_OK(0):found, FR_NO_FILE:not found, other:error */
+	DIR* dp,				/* Pointer to the directory object with the file name, at the entry to start from */
+#if FF_DIR_INDEX
+	DIRIDX* ix,				/* Index to extend as entries are scanned (0:none) */
+#endif
+	int one					/* Stop after one SFN entry */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE a, ord, sum;
+#endif
+#if FF_DIR_INDEX
+	IDXSCAN is = { 0xFF, 0xFF, 0xFFFFFFFF, 0 };
+#endif
+
 #if FF_USE_LFN
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2423,6 +2758,9 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		if (res != FR_OK) break;
 		c = dp->dir[DIR_Name];
 		if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
+#if FF_DIR_INDEX
+		if (ix) idx_scan(dp, ix, &is);
+#endif
 #if FF_USE_LFN		/* LFN configuration */
 		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
 		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
@@ -2442,6 +2780,7 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 				if (ord == 0 && sum == sum_sfn(dp->dir)) break;	/* LFN matched? */
 				if (!(dp->fn[NSFLAG] & NS_LOSS) && !memcmp(dp->dir, dp->fn, 11)) break;	/* SFN matched? */
 				ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+				if (one) { res = FR_NO_FILE; break; }
 			}
 		}
 #else		/* Non LFN configuration */
@@ -2451,10 +2790,147 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
+#if FF_DIR_INDEX
+	if (ix && res == FR_NO_FILE && !one && !(ix->stat & 2)) ix->stat |= 1;	/* The index now covers the whole directory */
+#endif
 	return res;
 }
 
 
+#if FF_FS_EXFAT
+static int cmp_xdir_name (	/* 1:matched, 0:not matched */
+	FATFS* fs		/* Filesystem object with the entry set in dirbuf and the name in lfnbuf */
+)
+{
+	BYTE nc;
+	UINT di, ni;
+
+
+#if FF_MAX_LFN < 255
+	if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) return 0;		/* Skip comparison if inaccessible object name */
+#endif
+	for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
+		if ((di % SZDIRE) == 0) di += 2;
+		if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
+	}
+	return nc == 0 && !fs->lfnbuf[ni];
+}
+#endif
+
+
+#if FF_DIR_INDEX
+static FRESULT idx_find (	/* FR_OK:found, FR_NO_FILE:not in the part covered by the index, other:error */
+	DIR* dp,
+	DIRIDX* ix
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DWORD hs = 0x10000, hl = 0x10000;	/* Hashes to look for (0x10000:none) */
+	DWORD last = 0x10000;	/* Entry block checked last */
+	UINT i;
+
+
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {
+		hl = xname_sum(fs->lfnbuf);
+	} else
+#endif
+	{
+		if (!(dp->fn[NSFLAG] & NS_LOSS)) hs = idx_hash_sfn(dp->fn);
+		if (!(dp->fn[NSFLAG] & NS_NOLFN)) hl = idx_hash_lfn(fs->lfnbuf);
+	}
+	for (i = 0; i < ix->nkey; i++) {	/* Check the entry blocks with a matching hash, in order */
+		if ((ix->key[i] >> 16) != hs && (ix->key[i] >> 16) != hl) continue;
+		if ((ix->key[i] & 0xFFFF) == last) continue;	/* Both hashes of a block matched */
+		last = ix->key[i] & 0xFFFF;
+		res = dir_sdi(dp, last * SZDIRE);
+		if (res != FR_OK) return res;
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {
+			res = DIR_READ_FILE(dp);
+			if (res == FR_OK) {
+				if (cmp_xdir_name(fs)) return res;
+				res = FR_NO_FILE;
+			}
+		} else
+#endif
+		{
+			res = dir_find_fat(dp, 0, 1);
+			if (res == FR_OK) return res;
+		}
+		if (res != FR_NO_FILE) return res;
+	}
+	return FR_NO_FILE;
+}
+
+
+static FRESULT idx_resume (	/* Move to the entry where the index ends (FR_NO_FILE:at the end of the directory) */
+	DIR* dp,
+	DIRIDX* ix
+)
+{
+	FRESULT res;
+
+
+	if (ix->end == 0) return dir_sdi(dp, 0);
+	res = dir_sdi(dp, (ix->end - 1) * SZDIRE);	/* The last entry covered surely exists */
+	if (res == FR_OK) res = dir_next(dp, 0);
+	return res;
+}
+#endif
+
+
+static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+#if FF_FS_EXFAT
+	FATFS *fs = dp->obj.fs;
+#endif
+#if FF_DIR_INDEX
+	DIRIDX* ix = idx_get(dp);	/* Index of the directory (0:not available) */
+
+	if (ix) {
+		res = idx_find(dp, ix);		/* Look up the name in the index */
+		if (res != FR_NO_FILE || (ix->stat & 1)) return res;
+		res = idx_resume(dp, ix);	/* Scan on from where the index ends */
+		if (res == FR_NO_FILE && !(ix->stat & 2)) ix->stat |= 1;
+	} else {
+		res = dir_sdi(dp, 0);			/* Rewind directory object */
+	}
+	if (res != FR_OK) return res;
+#else
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	if (res != FR_OK) return res;
+#endif
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
+
+		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
+#if FF_DIR_INDEX
+			if (ix) idx_scan(dp, ix, 0);
+#endif
+			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
+			if (cmp_xdir_name(fs)) break;	/* Name matched? */
+		}
+#if FF_DIR_INDEX
+		if (ix && res == FR_NO_FILE && !(ix->stat & 2)) ix->stat |= 1;
+#endif
+		return res;
+	}
+#endif
+	/* On the FAT/FAT32 volume */
+#if FF_DIR_INDEX
+	return dir_find_fat(dp, ix, 0);
+#else
+	return dir_find_fat(dp, 0);
+#endif
+}
+
+
 
 
 #if !FF_FS_READONLY
@@ -2475,6 +2951,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 
 	if (dp->fn[NSFLAG] & (NS_DOT | NS_NONAME)) return FR_INVALID_NAME;	/* Check name validity */
 	for (len = 0; fs->lfnbuf[len]; len++) ;	/* Get lfn length */
+#if FF_DIR_INDEX
+	idx_clear(fs);	/* The directory is going to change */
+#endif
 
 #if FF_FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
@@ -2519,6 +2998,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 		if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
 		if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
 		dp->fn[NSFLAG] = sn[NSFLAG];
+#if FF_DIR_INDEX
+		idx_clear(fs);	/* Drop the index built by the collision checks */
+#endif
 	}
 
 	/* Create an SFN with/without LFNs. */
@@ -2577,6 +3059,9 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_DIR_INDEX
+	idx_clear(fs);	/* The directory is going to change */
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -3563,6 +4048,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 #if !FF_FS_READONLY
 		/* Get FSInfo if available */
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
+#if FF_FREEMAP_SIZE
+		fmap_init(fs);
+#endif
 		fs->fsi_flag = 0x80;
 #if (FF_FS_NOFSINFO & 3) != 3
 		if (fmt == FS_FAT32				/* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
@@ -3586,6 +4074,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 #endif	/* !FF_FS_READONLY */
 	}
 
+#if FF_DIR_INDEX
+	idx_clear(fs);			/* Drop the indexes of the previous mount */
+#endif
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
 	fs->id = ++Fsid;		/* Volume mount ID */
 #if FF_USE_LFN == 1
@@ -3678,6 +4169,9 @@ FRESULT f_mount (
 #endif
 #if FF_FS_REENTRANT				/* Discard mutex of the current volume */
 		ff_mutex_delete(vol);
+#endif
+#if FF_DIR_INDEX
+		idx_clear(cfs);			/* Free the directory indexes */
 #endif
 		cfs->fs_type = 0;		/* Invalidate the filesystem object to be unregistered */
 	}
@@ -3698,6 +4192,10 @@ FRESULT f_mount (
 #endif
 #endif
 		fs->fs_type = 0;		/* Invalidate the new filesystem object */
+#if FF_DIR_INDEX
+		memset(fs->diridx, 0, sizeof fs->diridx);	/* No directory indexes yet */
+		fs->idxuse = 0;
+#endif
 		FatFs[vol] = fs;		/* Register new fs object */
 	}
 
@@ -3710,6 +4208,29 @@ FRESULT f_mount (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Check if a Buffer is the Sector Window of a Registered Volume         */
+/*-----------------------------------------------------------------------*/
+/* The window holds FAT, directory and other system sectors, and (only with
+/  FF_FS_TINY) file data. The disk I/O layer can use this to tell them apart
+/  from file data transfers. */
+
+int ff_is_window (
+	const void* buff	/* Buffer given to disk_read or disk_write */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_VOLUMES; i++) {
+		if (FatFs[i] && buff == FatFs[i]->win) return 1;
+	}
+	return 0;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Open or Create a File                                                 */
 /*-----------------------------------------------------------------------*/
@@ -3857,6 +4378,9 @@ FRESULT f_open (
 			}
 #if FF_USE_FASTSEEK
 			fp->cltbl = 0;		/* Disable fast seek mode */
+#endif
+#if FF_USE_EXTCACHE
+			fp->xcache = 0;		/* No extent cache */
 #endif
 			fp->obj.fs = fs;	/* Validate the file object */
 			fp->obj.id = fs->id;
@@ -3945,6 +4469,9 @@ FRESULT f_read (
 					if (fp->cltbl) {
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					} else
+#endif
+#if FF_USE_EXTCACHE
+					if ((clst = xc_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize))) == 0)	/* Get cluster# from the extent cache */
 #endif
 					{
 						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
@@ -3953,6 +4480,9 @@ FRESULT f_read (
 				if (clst < 2) ABORT(fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 				fp->clust = clst;				/* Update current cluster */
+#if FF_USE_EXTCACHE
+				xc_note(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize), clst);
+#endif
 			}
 			sect = clst2sect(fs, fp->clust);	/* Get current sector */
 			if (sect == 0) ABORT(fs, FR_INT_ERR);
@@ -4050,6 +4580,9 @@ FRESULT f_write (
 					if (fp->cltbl) {
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					} else
+#endif
+#if FF_USE_EXTCACHE
+					if ((clst = xc_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize))) == 0)	/* Get cluster# from the extent cache */
 #endif
 					{
 						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
@@ -4059,6 +4592,9 @@ FRESULT f_write (
 				if (clst == 1) ABORT(fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 				fp->clust = clst;			/* Update current cluster */
+#if FF_USE_EXTCACHE
+				xc_note(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize), clst);
+#endif
 				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
 			}
 #if FF_FS_TINY
@@ -4228,7 +4764,7 @@ FRESULT f_close (
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
 #if FF_FS_LOCK
-			res = dec_share(fp->obj.lockid);		/* Decrement file open counter */
+			res = dec_share_sys(fp->obj.lockid);	/* Decrement file open counter */
 			if (res == FR_OK) fp->obj.fs = 0;	/* Invalidate file object */
 #else
 			fp->obj.fs = 0;	/* Invalidate file object */
@@ -4445,6 +4981,9 @@ FRESULT f_lseek (
 	DWORD *tbl;
 	LBA_t dsc;
 #endif
+#if FF_USE_EXTCACHE
+	DWORD icl, xcl;
+#endif
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res == FR_OK) res = (FRESULT)fp->err;
@@ -4536,6 +5075,20 @@ FRESULT f_lseek (
 #endif
 				fp->clust = clst;
 			}
+#if FF_USE_EXTCACHE
+			if (clst != 0 && fp->xcache) {	/* Skip over the part of the chain in the extent cache */
+				icl = (DWORD)(fp->fptr / bcs);			/* Cluster offset of clst */
+				xcl = (DWORD)((fp->fptr + ofs - 1) / bcs);	/* Cluster offset of the destination */
+				if (icl == 0) xc_note(fp, 0, clst);
+				if (xcl >= fp->xcache->ncl) xcl = fp->xcache->ncl - 1;	/* Furthest cluster known */
+				if (fp->xcache->ncl > 0 && xcl > icl) {
+					clst = xc_clust(fp, xcl);
+					fp->fptr += (FSIZE_t)(xcl - icl) * bcs;
+					ofs -= (FSIZE_t)(xcl - icl) * bcs;
+					fp->clust = clst;
+				}
+			}
+#endif
 			if (clst != 0) {
 				while (ofs > bcs) {						/* Cluster following loop */
 					ofs -= bcs; fp->fptr += bcs;
@@ -4557,6 +5110,9 @@ FRESULT f_lseek (
 					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 					if (clst <= 1 || clst >= fs->n_fatent) ABORT(fs, FR_INT_ERR);
 					fp->clust = clst;
+#if FF_USE_EXTCACHE
+					xc_note(fp, (DWORD)(fp->fptr / bcs), clst);
+#endif
 				}
 				fp->fptr += ofs;
 				if (ofs % SS(fs)) {
@@ -4671,7 +5227,7 @@ FRESULT f_closedir (
 	res = validate(&dp->obj, &fs);	/* Check validity of the file object */
 	if (res == FR_OK) {
 #if FF_FS_LOCK
-		if (dp->obj.lockid) res = dec_share(dp->obj.lockid);	/* Decrement sub-directory open counter */
+		if (dp->obj.lockid) res = dec_share_sys(dp->obj.lockid);	/* Decrement sub-directory open counter */
 		if (res == FR_OK) dp->obj.fs = 0;	/* Invalidate directory object */
 #else
 		dp->obj.fs = 0;	/* Invalidate directory object */
@@ -4809,6 +5365,90 @@ FRESULT f_stat (
 
 
 #if !FF_FS_READONLY
+#if FF_GETFREE_SECTORS && FF_USE_LFN == 3
+/*-----------------------------------------------------------------------*/
+/* Count free clusters on FAT16/32 with multiple sector reads            */
+/*-----------------------------------------------------------------------*/
+
+static DWORD count_free_ents (	/* Number of zero entries */
+	FATFS* fs,			/* Filesystem object */
+	const BYTE* buf,	/* FAT sectors (DWORD aligned) */
+	DWORD i,			/* First entry to count */
+	DWORD j				/* Entry after the last to count */
+)
+{
+	DWORD n = 0, mask;
+	const DWORD* wp;
+
+
+	if (fs->fs_type == FS_FAT16) {
+		if (i < j && (i & 1)) n += ld_word(buf + i++ * 2) == 0;	/* Odd entry at either end */
+		if (i < j && (j & 1)) n += ld_word(buf + --j * 2) == 0;
+		for (wp = (const DWORD*)(buf + i * 2); i < j; i += 2, wp++) {	/* Two entries at a time */
+			n += ((*wp & 0xFFFF) == 0) + ((*wp >> 16) == 0);
+		}
+	} else {
+		memcpy(&mask, "\xFF\xFF\xFF\x0F", 4);	/* Mask off the upper 4 bits in native byte order */
+		for (wp = (const DWORD*)(buf + i * 4); i < j; i++, wp++) {
+			n += (*wp & mask) == 0;
+		}
+	}
+	return n;
+}
+
+
+static int count_free_bulk (	/* 0:Buffer not available (only without PICO_MALLOC_PANIC), 1:Counted (*res has the result) */
+	FATFS* fs,		/* Filesystem object */
+	DWORD* nfree,	/* Pointer to return number of free clusters */
+	FRESULT* res	/* Pointer to return result */
+)
+{
+	BYTE *buf;
+	LBA_t sect = fs->fatbase;
+	DWORD ent = 0, nent, nf = 0, epsec = SS(fs) / (fs->fs_type == FS_FAT16 ? 2 : 4);
+	UINT nsect;
+#if FF_FREEMAP_SIZE
+	DWORD i, j, gmask = ((DWORD)1 << fs->fmap_shift) - 1, gfree = 0;
+#endif
+
+
+	buf = ff_memalloc(FF_GETFREE_SECTORS * SS(fs));
+	if (!buf) return 0;
+	*res = sync_window(fs);	/* The window may hold a dirty FAT sector */
+	while (*res == FR_OK && ent < fs->n_fatent) {
+		nsect = (UINT)((fs->n_fatent - ent + epsec - 1) / epsec);	/* Sectors left */
+		if (nsect > FF_GETFREE_SECTORS) nsect = FF_GETFREE_SECTORS;
+		if (disk_read(fs->pdrv, buf, sect, nsect) != RES_OK) {
+			*res = FR_DISK_ERR; break;
+		}
+		sect += nsect;
+		nent = nsect * epsec;
+		if (nent > fs->n_fatent - ent) nent = fs->n_fatent - ent;
+#if FF_FREEMAP_SIZE
+		for (i = 0; i < nent; i = j) {	/* Count a group at a time to fill in the free map */
+			j = ((ent + i) | gmask) + 1 - ent;
+			if (j > nent) j = nent;
+			gfree += count_free_ents(fs, buf, i, j);
+			if (((ent + j) & gmask) == 0 || ent + j == fs->n_fatent) {	/* End of the group? */
+				if (gfree == 0) fmap_mark(fs, ent + j - 1, 1);
+				nf += gfree; gfree = 0;
+			}
+		}
+#else
+		nf += count_free_ents(fs, buf, 0, nent);
+#endif
+		ent += nent;
+#if FF_GETFREE_PROGRESS
+		ff_getfree_progress(fs, ent, fs->n_fatent);
+#endif
+	}
+	ff_memfree(buf);
+	*nfree = nf;
+	return 1;
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
@@ -4837,6 +5477,12 @@ FRESULT f_getfree (
 		} else {
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
+#if FF_GETFREE_SECTORS && FF_USE_LFN == 3
+			if ((fs->fs_type == FS_FAT16 || fs->fs_type == FS_FAT32)
+				&& count_free_bulk(fs, &nfree, &res)) {
+				/* Counted with multiple sector reads */
+			} else
+#endif
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
 				clst = 2; obj.fs = fs;
 				do {
@@ -4935,6 +5581,9 @@ FRESULT f_truncate (
 				res = remove_chain(&fp->obj, ncl, fp->clust);
 			}
 		}
+#if FF_USE_EXTCACHE
+		xc_trim(fp, fp->fptr == 0 ? 0 : (DWORD)((fp->fptr - 1) / SS(fs) / fs->csize) + 1);	/* Forget the removed clusters */
+#endif
 		fp->obj.objsize = fp->fptr;	/* Set file size to current read/write point */
 		fp->flag |= FA_MODIFIED;
 #if !FF_FS_TINY
@@ -5639,6 +6288,9 @@ FRESULT f_expand (
 			fp->obj.objsize = fsz;
 			if (FF_FS_EXFAT) fp->obj.stat = 2;	/* Set status 'contiguous chain' */
 			fp->flag |= FA_MODIFIED;
+#if FF_USE_EXTCACHE
+			xc_trim(fp, 0);				/* Forget any previous chain */
+#endif
 			if (fs->free_clst <= fs->n_fatent - 2) {	/* Update FSINFO */
 				fs->free_clst -= tcl;
 				fs->fsi_flag |= 1;
@@ -127,6 +127,22 @@ extern const char* VolumeStr[FF_VOLUMES];	/* User defied volume ID */
 
 
 
+/* Directory index (see FF_DIR_INDEX) */
+
+#if FF_DIR_INDEX
+typedef struct {
+	DWORD*	key;			/* Keys: name hash << 16 | index of the entry block (0:unused) */
+	UINT	nkey;			/* Number of keys */
+	UINT	szkey;			/* Size of key[] in items */
+	DWORD	sclust;			/* Directory start cluster (0:root directory on FAT12/16) */
+	DWORD	end;			/* Number of directory entries covered by the index */
+	DWORD	use;			/* Last use, for replacement */
+	BYTE	stat;			/* b0:covers the whole directory, b1:cannot grow */
+} DIRIDX;
+#endif
+
+
+
 /* Filesystem object structure (FATFS) */
 
 typedef struct {
@@ -151,6 +167,10 @@ typedef struct {
 #if !FF_FS_READONLY
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
+#if FF_FREEMAP_SIZE
+	BYTE	fmap_shift;		/* Free cluster map: log2 of clusters per group */
+	BYTE	fmap[FF_FREEMAP_SIZE];	/* Free cluster map: bit set if group is in use */
+#endif
 #endif
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
@@ -168,6 +188,10 @@ typedef struct {
 	LBA_t	database;		/* Data base sector */
 #if FF_FS_EXFAT
 	LBA_t	bitbase;		/* Allocation bitmap base sector */
+#endif
+#if FF_DIR_INDEX
+	DIRIDX	diridx[FF_DIR_INDEX];	/* Directory indexes */
+	DWORD	idxuse;			/* Use counter of the directory indexes */
 #endif
 	LBA_t	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
@@ -198,6 +222,24 @@ typedef struct {
 
 
 
+#if FF_USE_EXTCACHE
+/* Extent cache (FXCACHE) */
+
+typedef struct {
+	DWORD	top;			/* Cluster offset of the extent from top of the file */
+	DWORD	clst;			/* First cluster of the extent */
+} FEXT;
+
+typedef struct {
+	FEXT*	ext;			/* Extents in file order, each running to the top of the next one */
+	UINT	size;			/* Number of items in ext[] */
+	UINT	n;				/* Number of extents held (0 when attached) */
+	DWORD	ncl;			/* Number of clusters from top of the file covered by ext[] (0 when attached) */
+} FXCACHE;
+#endif
+
+
+
 /* File object structure (FIL) */
 
 typedef struct {
@@ -214,6 +256,9 @@ typedef struct {
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
+#if FF_USE_EXTCACHE
+	FXCACHE*	xcache;		/* Pointer to the extent cache (nulled on open, set by application) */
+#endif
 #if !FF_FS_TINY
 	BYTE	buf[FF_MAX_SS];	/* File private data read/write window */
 #endif
@@ -360,6 +405,16 @@ DWORD get_fattime (void);	/* Get current time */
 #endif
 
 
+/* Progress of the free cluster count (provided by user) */
+#if !FF_FS_READONLY && FF_GETFREE_PROGRESS
+void ff_getfree_progress (FATFS* fs, DWORD done, DWORD total);	/* FAT entries scanned so far */
+#endif
+
+
+/* Is buff the sector window of a registered volume? (for the disk I/O layer) */
+int ff_is_window (const void* buff);
+
+
 /* LFN support functions (defined in ffunicode.c) */
 
 #if FF_USE_LFN >= 1
@@ -38,7 +38,16 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXTCACHE	1
+/* This option switches the extent cache. (0:Disable or 1:Enable)
+/  When an application points fp->xcache of an open file to an FXCACHE, the cluster
+/  chain is recorded there as contiguous extents as file functions follow it, and
+/  f_lseek() goes straight to a recorded cluster instead of following the chain from
+/  top of the file. Unlike fast seek, the file can grow and shrink. A full cache keeps
+/  the extents it holds, so it still covers the first part of the file. */
+
+
+#define FF_USE_EXPAND	1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
@@ -213,7 +222,7 @@
 /  f_fdisk function. 0x100000000 max. This option has no effect when FF_LBA64 == 0. */
 
 
-#define FF_USE_TRIM		0
+#define FF_USE_TRIM		1
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
 /  disk_ioctl() function. */
@@ -263,6 +272,53 @@
 */
 
 
+#define FF_FREEMAP_SIZE	1024
+/* This option sets the size in bytes of the free cluster map kept in each
+/  filesystem object. (0:Disable) Each bit of the map tells if a group of clusters
+/  is known to be in use, so that the cluster allocation on the FAT volume can skip
+/  it instead of reading its FAT entries. The group size is set at mount time so
+/  that the map covers the volume. The map is filled in as the FAT is scanned. */
+
+
+#define FF_GETFREE_SECTORS	8
+/* This option sets the number of sectors that f_getfree() reads at a time when it
+/  counts the free clusters on a FAT16/32 volume. (0:Disable) The buffer is taken
+/  with ff_memalloc(), so this option has no effect unless FF_USE_LFN == 3. If the
+/  buffer cannot be allocated, the FAT is scanned a sector at a time; but with the
+/  Pico SDK's PICO_MALLOC_PANIC (its default), malloc() panics instead of failing,
+/  so keep the buffer small enough for the heap to supply it even when fragmented.
+/  The default, 8 sectors, is 4 KiB with 512 byte sectors. */
+
+
+#define FF_GETFREE_PROGRESS	1
+/* This option switches the progress report of the f_getfree() FAT scan. (0:Disable
+/  or 1:Enable) When enabled, a user provided function ff_getfree_progress() is
+/  called after each FF_GETFREE_SECTORS chunk of the FAT is read. */
+
+
+#define FF_DIR_INDEX	2
+/* This option sets the number of directories per volume that get an in-memory
+/  index of name hashes, so that looking up a name does not have to read and
+/  compare every entry before it. (0:Disable) The most recently used directories
+/  are indexed. An index is built as the directory is scanned, takes about 4 bytes
+/  per name from ff_memalloc(), and is dropped whenever an entry is added to or
+/  removed from a directory on the volume. FF_USE_LFN must be 3. */
+
+
+#define FF_DIR_INDEX_MAX_KEYS	2048
+/* This option sets the most names a directory index can hold, which bounds its
+/  memory at 4 bytes per name (8 KiB for 2048 names). Names beyond that are not
+/  indexed: looking them up scans the rest of the directory as usual. */
+
+
+#define FF_LFN_BUF_POOL	2
+/* This option sets the number of LFN working buffers kept in a pool in static
+/  memory, so that functions taking a path name do not have to allocate and free
+/  one on the heap. (0:Disable) A buffer is in use for the duration of a file
+/  function, so 2 covers one function in progress on each core. When they are
+/  all in use, ff_memalloc() falls back to the heap. FF_USE_LFN must be 3. */
+
+
 #define FF_FS_LOCK		16
 /* The option FF_FS_LOCK switches file lock function to control duplicated file open
 /  and illegal operation to open objects. This option must be 0 when FF_FS_READONLY
@@ -275,8 +331,8 @@
 /      lock control is independent of re-entrancy. */
 
 
-#define FF_FS_REENTRANT	0
-#define FF_FS_TIMEOUT	1000
+#define FF_FS_REENTRANT	1
+#define FF_FS_TIMEOUT	10000
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -289,6 +345,9 @@
 /      function, must be added to the project. Samples are available in ffsystem.c.
 /
 /  The FF_FS_TIMEOUT defines timeout period in unit of O/S time tick.
+/  (Pico SDK, OS_TYPE 5 in ffsystem.c: milliseconds. A call such as a large
+/  f_write() or the first f_getfree() on a big FAT32 volume can hold the volume
+/  for seconds.)
 */
 
 
@@ -13,11 +13,40 @@
 
 #include <stdlib.h>		/* with POSIX API */
 
+#if FF_LFN_BUF_POOL
+#include "obj_pool.h"
+
+/* Size of the LFN working buffer requested by INIT_NAMBUF in ff.c */
+#if FF_FS_EXFAT
+#define LFN_BUF_SIZE	((FF_MAX_LFN + 1) * 2 + (FF_MAX_LFN + 44U) / 15 * 32)
+#else
+#define LFN_BUF_SIZE	((FF_MAX_LFN + 1) * 2)
+#endif
+
+static DWORD LfnBuf[FF_LFN_BUF_POOL][(LFN_BUF_SIZE + 3) / 4];	/* Pool of LFN working buffers */
+auto_init_mutex(LfnBufMutex);
+static obj_pool_t LfnBufPool = OBJ_POOL_INIT(LfnBuf, sizeof LfnBuf[0], FF_LFN_BUF_POOL, &LfnBufMutex);
+
+
+void ff_memalloc_get_stats (
+	obj_pool_stats_t* stats	/* Usage of the LFN buffer pool: exhausted counts the buffers taken from the heap */
+)
+{
+	obj_pool_get_stats(&LfnBufPool, stats);
+}
+#endif
+
 
 void* ff_memalloc (	/* Returns pointer to the allocated memory block (null if not enough core) */
 	UINT msize		/* Number of bytes to allocate */
 )
 {
+#if FF_LFN_BUF_POOL
+	if (msize == LFN_BUF_SIZE) {	/* LFN working buffer? */
+		void* mblock = obj_pool_alloc(&LfnBufPool);
+		if (mblock) return mblock;
+	}
+#endif
 	return malloc((size_t)msize);	/* Allocate a new memory block */
 }
 
@@ -26,12 +55,31 @@ void ff_memfree (
 	void* mblock	/* Pointer to the memory block to free (no effect if null) */
 )
 {
+#if FF_LFN_BUF_POOL
+	if (mblock && obj_pool_owns(&LfnBufPool, mblock)) {
+		obj_pool_free(&LfnBufPool, mblock);
+		return;
+	}
+#endif
 	free(mblock);	/* Free the memory block */
 }
 
 #endif
 
 
+#if !FF_LFN_BUF_POOL
+#include <string.h>
+#include "obj_pool.h"
+
+void ff_memalloc_get_stats (
+	obj_pool_stats_t* stats	/* Zeroed: there is no LFN buffer pool */
+)
+{
+	memset(stats, 0, sizeof *stats);
+}
+#endif
+
+
 
 
 #if FF_FS_REENTRANT	/* Mutal exclusion */
@@ -39,7 +87,7 @@ void ff_memfree (
 /* Definitions of Mutex                                                   */
 /*------------------------------------------------------------------------*/
 
-#define OS_TYPE	0	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS */
+#define OS_TYPE	5	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS, 5:Pico SDK */
 
 
 #if   OS_TYPE == 0	/* Win32 */
@@ -64,6 +112,10 @@ static SemaphoreHandle_t Mutex[FF_VOLUMES + 1];	/* Table of mutex handle */
 #include "cmsis_os.h"
 static osMutexId Mutex[FF_VOLUMES + 1];	/* Table of mutex ID */
 
+#elif OS_TYPE == 5	/* Pico SDK */
+#include "pico/mutex.h"
+static mutex_t Mutex[FF_VOLUMES + 1];	/* Table of mutex (owned by a core, so a volume can be in use on one core at a time) */
+
 #endif
 
 
@@ -106,6 +158,10 @@ int ff_mutex_create (	/* Returns 1:Function succeeded or 0:Could not create the
 	Mutex[vol] = osMutexCreate(osMutex(cmsis_os_mutex));
 	return (int)(Mutex[vol] != NULL);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	mutex_init(&Mutex[vol]);
+	return 1;
+
 #endif
 }
 
@@ -138,6 +194,9 @@ void ff_mutex_delete (	/* Returns 1:Function succeeded or 0:Could not delete due
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexDelete(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	(void)vol;	/* Nothing to free */
+
 #endif
 }
 
@@ -171,6 +230,9 @@ int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	return (int)(osMutexWait(Mutex[vol], FF_FS_TIMEOUT) == osOK);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	return (int)mutex_enter_timeout_ms(&Mutex[vol], FF_FS_TIMEOUT);
+
 #endif
 }
 
@@ -201,6 +263,9 @@ void ff_mutex_give (
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexRelease(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* Pico SDK */
+	mutex_exit(&Mutex[vol]);
+
 #endif
 }
 
@@ -0,0 +1,92 @@
+/* bin_log.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Binary log files: small binary records, each with its own length and CRC,
+// packed into sector sized blocks (see bin_log_format.h). Records are
+// collected in RAM and written a block at a time; bin_log_sync writes the
+// partly filled block too and calls f_sync.
+//
+// After a power failure, bin_log_recover finds the end of the log with a
+// binary search on the block headers, reading about log2(blocks) sectors,
+// and bin_log_open carries on from there. Preallocating the file (see
+// bin_log_open) keeps the directory entry and FAT out of the way while
+// logging, and is what makes the search necessary: the file size no
+// longer says where the log ends.
+//
+// tools/bin_log_decode.c converts the files to CSV on a host computer.
+//
+// Not thread safe: use each bin_log_t from one place.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+//
+#include "bin_log_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if FF_MIN_SS != BIN_LOG_BLOCK_SIZE
+#error Binary log blocks are expected to be one sector
+#endif
+
+typedef struct {
+    uint32_t records;        // Records appended
+    uint32_t blocks_written;
+    uint32_t syncs;
+} bin_log_stats_t;
+
+// Where a log ends, as found by bin_log_recover
+typedef struct {
+    uint32_t file_id;
+    uint32_t blocks;    // Blocks in the log, including the last, partial one
+    uint16_t used;      // Valid bytes in the last block, including its header
+    uint32_t records;   // Valid records in the last block
+    uint32_t reads;     // Blocks read to find this out
+} bin_log_end_t;
+
+typedef struct {
+    FIL file;
+    uint32_t file_id;
+    uint32_t seq;            // Block being filled
+    uint16_t used;           // Bytes of it in use
+    bool dirty;              // It has records that haven't been written
+    uint8_t block[BIN_LOG_BLOCK_SIZE];
+    bin_log_stats_t stats;
+} bin_log_t;
+
+// Open path for appending. If it doesn't exist, it is created and, if
+// prealloc is not 0, that many bytes of contiguous space are allocated
+// for it up front. If it does, the log is continued where it ends.
+FRESULT bin_log_open(bin_log_t *log, const TCHAR *path, FSIZE_t prealloc);
+// FR_INVALID_PARAMETER if len > BIN_LOG_MAX_PAYLOAD
+FRESULT bin_log_append(bin_log_t *log, uint8_t type, const void *payload,
+                       size_t len);
+// Describe the payload of type with a type 0 record (see bin_log_format.h)
+FRESULT bin_log_define(bin_log_t *log, uint8_t type, const char *format,
+                       const char *columns);
+FRESULT bin_log_sync(bin_log_t *log);
+FRESULT bin_log_close(bin_log_t *log);
+// Find the end of the log in an open file, leaving its last block in block.
+// FR_NO_FILE if the file doesn't start with a valid block.
+FRESULT bin_log_recover(FIL *fp, uint8_t block[BIN_LOG_BLOCK_SIZE],
+                        bin_log_end_t *end);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,54 @@
+/* bin_log_format.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Layout of the binary log files written by bin_log.c. Kept free of
+// FatFs and Pico SDK dependencies so that host tools can use it.
+//
+// A file is a sequence of blocks of BIN_LOG_BLOCK_SIZE bytes, each starting
+// with a block header. Block n has seq n, and every block in a file has the
+// file_id of block 0, so the written part of a file is the longest run of
+// blocks from 0 with valid headers. Anything after that (e.g., preallocated
+// space holding old data) is ignored.
+//
+// Records follow the header, packed, up to the header's used count, and
+// never span blocks:
+//   len (1 byte), type (1 byte), payload (len bytes),
+//   CRC16 of len, type and payload (2 bytes, little endian)
+//
+// Type 0 records describe the payload of another type, so that a decoder
+// can print it without knowing the application:
+//   type described (1 byte), format, NUL, column names (comma separated)
+// where format has a character per field, little endian, packed:
+//   b/B: int8/uint8, h/H: int16/uint16, i/I: int32/uint32,
+//   q/Q: int64/uint64, f: float, d: double,
+//   t: uint32 seconds since 1970 (two columns: date and time)
+
+#pragma once
+
+#define BIN_LOG_BLOCK_SIZE 512
+#define BIN_LOG_MAGIC 0x474F4C42  // "BLOG"
+
+// Block header: all fields little endian
+#define BIN_LOG_HDR_MAGIC 0    // uint32_t BIN_LOG_MAGIC
+#define BIN_LOG_HDR_FILE_ID 4  // uint32_t
+#define BIN_LOG_HDR_SEQ 8      // uint32_t block number
+#define BIN_LOG_HDR_USED 12    // uint16_t bytes used, including the header
+#define BIN_LOG_HDR_CRC 14     // uint16_t CRC16 of the preceding bytes
+#define BIN_LOG_HDR_SIZE 16
+
+#define BIN_LOG_REC_OVERHEAD 4  // len, type, CRC16
+#define BIN_LOG_MAX_PAYLOAD 255
+
+#define BIN_LOG_TYPE_SCHEMA 0
+
+/* [] END OF FILE */
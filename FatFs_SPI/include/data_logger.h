@@ -0,0 +1,93 @@
+/* data_logger.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Buffered data logging.
+//
+// Producers append records to a RAM ring buffer with data_logger_write,
+// which is safe to call from interrupt handlers and from either core, and
+// never waits for the card. data_logger_task, called regularly from one
+// place (e.g., the super loop), writes the buffer to the current log file
+// in batches of whole sectors, calls f_sync every sync_period_ms, and starts
+// a new file every hour, named <dir>/YYYY-MM-DD/HH<suffix>.
+// If the buffer fills up, records are dropped (and counted), never split.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "pico/critical_section.h"
+#include "pico/time.h"
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest record data_logger_printf can produce
+#ifndef DATA_LOGGER_MAX_RECORD
+#define DATA_LOGGER_MAX_RECORD 128
+#endif
+
+typedef struct {
+    uint32_t records;        // Records appended
+    uint32_t dropped;        // Records dropped because the buffer was full
+    uint32_t max_used;       // Most bytes waiting in the buffer
+    uint64_t bytes_written;
+    uint32_t writes;         // f_write calls
+    uint32_t syncs;          // f_sync calls
+    uint32_t files;          // Files opened
+} data_logger_stats_t;
+
+// "Class" representing a data logger
+typedef struct {
+    // Set these, then call data_logger_init:
+    const char *dir;     // Directory for the log files, e.g., "0:/data"
+    const char *suffix;  // File name suffix, e.g., ".csv"
+    const char *header;  // Written at the top of each new file (optional)
+    uint8_t *buf;        // Ring buffer
+    size_t buf_size;     // A power of 2, at least 1024
+    size_t batch_size;   // Write when this many bytes are waiting (0: buf_size / 4)
+    uint32_t sync_period_ms;  // How often to f_sync (0: only when changing files)
+
+    // State:
+    critical_section_t crit;  // Guards head and stats.records, stats.dropped
+    volatile uint32_t head;   // Bytes appended since init
+    volatile uint32_t tail;   // Bytes written since init
+    FIL file;
+    bool file_open;
+    int file_hour, file_mday;  // When the open file was started
+    absolute_time_t next_sync;
+    bool unsynced;
+    FRESULT error;  // FR_DENIED once the volume is full; nothing more is written
+    data_logger_stats_t stats;
+} data_logger_t;
+
+bool data_logger_init(data_logger_t *logger);
+// Append a record. Returns false if it was dropped.
+bool data_logger_write(data_logger_t *logger, const void *record, size_t len);
+bool data_logger_printf(data_logger_t *logger, const char *fmt, ...)
+    __attribute__((format(__printf__, 2, 3)));
+// Write out what is due. Returns false on a file system error, after
+// which it will try again (with a new file) on the next call; except when
+// the volume is full (error is FR_DENIED), after which it only returns false.
+bool data_logger_task(data_logger_t *logger);
+// Write out everything, sync and close the file
+bool data_logger_close(data_logger_t *logger);
+void data_logger_get_stats(data_logger_t *logger, data_logger_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -12,7 +12,10 @@ CONDITIONS OF ANY KIND, either express or implied. See the License for the
 specific language governing permissions and limitations under the License.
 */
 #pragma once
+#include <stdbool.h>
+//
 #include "ff.h"
+#include "obj_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,6 +28,33 @@ extern "C" {
         FILINFO* fno    /* Name read buffer */
     );
 
+    // Core 1 does background work for f_getfree_start, the I/O engine
+    // (io_engine.h) and multicore_stress_test in the example, one at a time.
+    // Claim it before launching anything on it (multicore_launch_core1):
+    // false if owner couldn't have it because it is in use.
+    bool core1_claim(const char *owner);
+    void core1_release();
+    // Who has claimed core 1, or NULL if it's free
+    const char *core1_owner();
+
+    // Counting the free clusters (f_getfree) in the background, on core 1.
+    // Returns false if core 1 is in use (see core1_claim). The volume is locked while it
+    // runs (FF_FS_REENTRANT), so calls on it from core 0 wait for it (up to
+    // FF_FS_TIMEOUT).
+    // progress (optional) is called on core 1 with the number of FAT entries
+    // scanned so far.
+    typedef void (*getfree_progress_t)(DWORD done, DWORD total);
+    bool f_getfree_start(const TCHAR *path, getfree_progress_t progress);
+    // Returns true when the count is finished, with its result in *fr and
+    // *nclst. Core 1 is free again from then on.
+    bool f_getfree_done(FRESULT *fr, DWORD *nclst);
+
+    // Usage of the pool of LFN working buffers behind ff_memalloc
+    // (FF_LFN_BUF_POOL in ffconf.h). stats->allocs counts the buffers that
+    // came from the pool instead of the heap, and stats->exhausted those
+    // that still had to come from the heap. All zero when there is no pool.
+    void ff_memalloc_get_stats(obj_pool_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
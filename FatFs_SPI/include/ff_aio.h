@@ -0,0 +1,53 @@
+/* ff_aio.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Asynchronous versions of ff_fread, ff_fwrite and ff_fflush, in the style
+// of POSIX aio. They queue the operation for the I/O engine (io_engine.h),
+// which is started on first use, and return at once. The control block is
+// the handle for the request: poll it with ff_aio_error or wait for it with
+// ff_aio_suspend, then get the result with ff_aio_return.
+//
+// Requests are carried out in the order they were made, so several can be
+// outstanding on a file; each works at the file position left by the one
+// before. The control block and the buffer must stay put until the request
+// is done. Call only from core 0.
+
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+//
+#include "io_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef io_request_t ff_aiocb_t;
+
+// Return 0 if the request was queued, or -1 with errno set (EAGAIN: too
+// many requests outstanding; ENOSYS: the engine couldn't be started, e.g. because core 1 is in use).
+int ff_aio_read(FIL *pxStream, void *pvBuffer, size_t xSize, ff_aiocb_t *pxCb);
+int ff_aio_write(FIL *pxStream, const void *pvBuffer, size_t xSize, ff_aiocb_t *pxCb);
+int ff_aio_fsync(FIL *pxStream, ff_aiocb_t *pxCb);
+// EINPROGRESS while the request is outstanding, then 0 or its errno
+int ff_aio_error(ff_aiocb_t *pxCb);
+// Bytes transferred by a finished read or write
+ssize_t ff_aio_return(ff_aiocb_t *pxCb);
+// Wait for any of the listed requests to finish. Returns 0, or -1 with
+// errno EAGAIN if none finished within timeout_us (0: wait for ever).
+int ff_aio_suspend(ff_aiocb_t *const list[], int nent, uint64_t timeout_us);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -20,11 +20,11 @@ specific language governing permissions and limitations under the License.
 #include "ff.h"
 //
 #include "my_debug.h"
+#include "obj_pool.h"
 
 #define BaseType_t int
 #define FF_FILE FIL
 
-#define ff_rewind f_rewind
 #define pvPortMalloc malloc
 #define vPortFree free
 #define ffconfigMAX_FILENAME 250
@@ -37,8 +37,11 @@ specific language governing permissions and limitations under the License.
 #define FF_SEEK_END 2
 #define pdFALSE 0
 #define pdTRUE 1
-#define ff_filelength f_size
-#define ff_feof f_eof
+
+// Buffering modes for ff_setvbuf
+#define FF_IOFBF 0  // Full: FatFs is called when the buffer fills or empties
+#define FF_IOLBF 1  // Line: as full, but output is also written at each '\n'
+#define FF_IONBF 2  // None: each call goes straight to FatFs
 
 typedef struct FF_STAT {
     uint32_t st_size; /* Size of the object in number of bytes. */
@@ -75,3 +78,26 @@ FF_FILE *ff_truncate( const char * pcFileName, long lTruncateSize );
 int ff_seteof( FF_FILE *pxStream );
 int ff_rename( const char *pcOldName, const char *pcNewName, int bDeleteIfExists );
 char *ff_fgets(char *pcBuffer, size_t xCount, FF_FILE *pxStream);
+int ff_fflush(FF_FILE *pxStream);
+// Give a stream a buffer of xSize bytes, allocated if pcBuffer is NULL.
+// Streams start unbuffered, unless FF_STDIO_BUFSIZ (see ff_stdio.c) is set.
+int ff_setvbuf(FF_FILE *pxStream, char *pcBuffer, int iMode, size_t xSize);
+void ff_rewind(FF_FILE *pxStream);
+size_t ff_filelength(FF_FILE *pxStream);
+int ff_feof(FF_FILE *pxStream);
+// Some of the above, returning the FatFs result instead of setting errno.
+// Without an RTOS, errno is shared by both cores, so code on core 1 (e.g.,
+// the I/O engine) can't rely on it. Sizes are in bytes.
+FF_FILE *ff_fopen_fr(const char *pcFile, const char *pcMode, FRESULT *fr);
+FRESULT ff_fclose_fr(FF_FILE *pxStream);
+FRESULT ff_fwrite_fr(const void *pvBuffer, size_t xSize, FF_FILE *pxStream,
+                     size_t *pxWritten);
+FRESULT ff_fread_fr(void *pvBuffer, size_t xSize, FF_FILE *pxStream,
+                    size_t *pxRead);
+FRESULT ff_fseek_fr(FF_FILE *pxStream, int iOffset, int iWhence);
+FRESULT ff_fflush_fr(FF_FILE *pxStream);
+int fresult2errno(FRESULT fr);
+// Usage of the pools of streams and ff_findfirst working space
+// (FF_STDIO_STREAMS and FF_STDIO_FIND_BUFS in ff_stdio.c)
+void ff_stdio_get_pool_stats(obj_pool_stats_t *streams,
+                             obj_pool_stats_t *find_bufs);
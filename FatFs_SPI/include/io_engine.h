@@ -0,0 +1,116 @@
+/* io_engine.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Runs file I/O on core 1, so that core 0 never waits for the SD card.
+//
+// Core 0 fills in an io_request_t and submits it, which only puts it on a
+// queue and rings core 1's doorbell (the inter-core FIFO). Core 1 carries it
+// out with the ff_stdio functions and queues it back. Core 0 picks up finished
+// requests with io_engine_poll, which calls their callbacks.
+//
+// The engine owns core 1 (and its end of the inter-core FIFO) while it runs.
+// The queues are single producer, single consumer: submit and poll only
+// from core 0.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of requests that can be in flight. Must be a power of 2.
+#ifndef IO_ENGINE_QUEUE_DEPTH
+#define IO_ENGINE_QUEUE_DEPTH 16
+#endif
+
+// Carry out requests as they are submitted, on the submitting core, instead
+// of on core 1. Completions still come through io_engine_poll, so code
+// written for the engine runs unchanged (but blocking) where core 1 is busy
+// with something else. tools/aio_host_test.c builds the engine and ff_aio
+// on the host, in both modes, against in-memory files.
+#ifndef IO_ENGINE_INLINE
+#define IO_ENGINE_INLINE 0
+#endif
+
+typedef enum {
+    IO_OPEN,   // ff_fopen(path, mode): sets file
+    IO_CLOSE,  // ff_fclose(file)
+    IO_READ,   // ff_fread(buf, 1, len, file): result is the number of bytes read
+    IO_WRITE,  // ff_fwrite(buf, 1, len, file): result is the number of bytes written
+    IO_SEEK,   // ff_fseek(file, offset, whence)
+    IO_SYNC    // ff_fflush(file)
+} io_op_t;
+
+typedef struct io_request_t io_request_t;
+typedef void (*io_callback_t)(io_request_t *req);
+
+// Owned by the caller from submission until completion, along with buf and
+// path: the engine doesn't copy them.
+struct io_request_t {
+    io_op_t op;
+    FIL *file;         // Stream from ff_fopen (FF_FILE *)
+    const char *path;  // IO_OPEN
+    const char *mode;  // IO_OPEN
+    void *buf;         // IO_READ, IO_WRITE
+    size_t len;        // IO_READ, IO_WRITE
+    int offset;        // IO_SEEK
+    int whence;        // IO_SEEK: FF_SEEK_SET, FF_SEEK_CUR or FF_SEEK_END
+    io_callback_t callback;  // Called by io_engine_poll on core 0 (optional)
+    void *context;           // For the callback
+
+    // Set by the engine:
+    bool done;      // Set by io_engine_poll
+    size_t result;  // Bytes transferred (IO_READ, IO_WRITE)
+    int error;      // errno value for the FatFs result (0: success)
+    uint64_t submit_us, start_us, finish_us;  // time_us_64() timestamps
+};
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t rejected;        // Submissions refused because the queue was full
+    uint32_t completed;
+    uint32_t errors;          // Completed with error != 0
+    uint32_t max_depth;       // Most requests in flight at once
+    uint64_t total_wait_us;   // Time requests spent queued before core 1 took them
+    uint64_t total_service_us;  // Time core 1 spent on requests
+    uint32_t max_wait_us;
+    uint32_t max_service_us;
+    uint32_t max_latency_us;  // Longest time from submission to completion
+} io_engine_stats_t;
+
+// Launches the engine on core 1. False if it's already running or core 1
+// is in use (see core1_claim in f_util.h).
+bool io_engine_start();
+bool io_engine_running();
+// Finishes the requests in flight (calling io_engine_poll) and stops core 1
+void io_engine_stop();
+// Queues req for core 1; false if the engine isn't running or the queue is full.
+// Never blocks.
+bool io_engine_submit(io_request_t *req);
+// Completes finished requests: sets their done flags and calls their callbacks.
+// Returns the number completed.
+unsigned io_engine_poll();
+// Requests submitted and not yet completed by io_engine_poll
+unsigned io_engine_in_flight();
+void io_engine_get_stats(io_engine_stats_t *stats);
+void io_engine_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
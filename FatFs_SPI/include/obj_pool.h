@@ -0,0 +1,71 @@
+/* obj_pool.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Fixed capacity pools of equal sized objects in static memory: allocation
+// and freeing take constant time and don't fragment the heap. Safe to use
+// from both cores (not from interrupt handlers).
+//
+// Example:
+//   static foo_t foos[8];
+//   auto_init_mutex(foo_pool_mutex);
+//   static obj_pool_t foo_pool =
+//       OBJ_POOL_INIT(foos, sizeof(foo_t), count_of(foos), &foo_pool_mutex);
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "pico/mutex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t capacity;
+    size_t in_use;
+    size_t high_water;   // Most objects in use at once
+    uint32_t allocs;     // Successful allocations
+    uint32_t exhausted;  // Allocations that failed because all were in use
+} obj_pool_stats_t;
+
+// "Class" representing an object pool
+typedef struct {
+    uint8_t *mem;       // capacity objects of block_size bytes
+    size_t block_size;  // At least sizeof(void *)
+    size_t capacity;
+    mutex_t *mutex;
+    void *free_list;  // Objects that have been freed
+    size_t fresh;     // Objects from this index on have never been allocated
+    obj_pool_stats_t stats;
+} obj_pool_t;
+
+#define OBJ_POOL_INIT(mem_, block_size_, capacity_, mutex_)           \
+    {                                                                 \
+        .mem = (uint8_t *)(mem_), .block_size = (block_size_),        \
+        .capacity = (capacity_), .mutex = (mutex_),                   \
+        .stats = {.capacity = (capacity_) }                           \
+    }
+
+// NULL if all are in use
+void *obj_pool_alloc(obj_pool_t *pool);
+void obj_pool_free(obj_pool_t *pool, void *obj);
+// Whether obj is one of pool's objects
+bool obj_pool_owns(const obj_pool_t *pool, const void *obj);
+void obj_pool_get_stats(obj_pool_t *pool, obj_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -28,6 +28,8 @@ specific language governing permissions and limitations under the License.
  * limitations under the License.
  */
 
+#include <stdbool.h>
+//
 #include "crc.h"
 
 static const char m_Crc7Table[] = {0x00, 0x09, 0x12, 0x1B, 0x24, 0x2D, 0x36,
@@ -84,6 +86,28 @@ static const unsigned short m_Crc16Table[256] = {0x0000, 0x1021, 0x2042,
 	0x8FD9, 0x9FF8, 0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1,
 	0x1EF0};
 
+#if CRC16_SLICE_BY != 1 && CRC16_SLICE_BY != 4 && CRC16_SLICE_BY != 8
+#  error "CRC16_SLICE_BY must be 1, 4, or 8"
+#endif
+
+#if CRC16_SLICE_BY > 1
+// m_Crc16Slices[k - 1][i] is the CRC of byte i followed by k zero bytes
+static unsigned short m_Crc16Slices[CRC16_SLICE_BY - 1][256];
+static volatile bool m_Crc16SlicesReady;
+
+static void crc16_init_slices(void) {
+	for (int i = 0; i < 256; i++) {
+		unsigned short crc = m_Crc16Table[i];
+		for (int k = 0; k < CRC16_SLICE_BY - 1; k++) {
+			crc = (crc << 8) ^ m_Crc16Table[crc >> 8];
+			m_Crc16Slices[k][i] = crc;
+		}
+	}
+	// Generating the tables twice (e.g., from both cores) is harmless
+	m_Crc16SlicesReady = true;
+}
+#endif
+
 char crc7(const char* data, int length)
 {
 	//Calculate the CRC7 checksum for the specified data block
@@ -96,7 +120,19 @@ char crc7(const char* data, int length)
 	return crc;
 }
 
-unsigned short crc16(const char* data, int length)
+// CRC7 of a 5 byte command packet (command index and argument)
+char crc7_cmd(const char cmd_packet[5])
+{
+	const unsigned char *p = (const unsigned char *)cmd_packet;
+	unsigned char crc = m_Crc7Table[p[0]];
+	crc = m_Crc7Table[(crc << 1) ^ p[1]];
+	crc = m_Crc7Table[(crc << 1) ^ p[2]];
+	crc = m_Crc7Table[(crc << 1) ^ p[3]];
+	crc = m_Crc7Table[(crc << 1) ^ p[4]];
+	return crc;
+}
+
+unsigned short crc16_bytewise(const char* data, int length)
 {
 	//Calculate the CRC16 checksum for the specified data block
 	unsigned short crc = 0;
@@ -108,6 +144,37 @@ unsigned short crc16(const char* data, int length)
 	return crc;
 }
 
+unsigned short crc16(const char* data, int length)
+{
+#if CRC16_SLICE_BY == 1
+	return crc16_bytewise(data, length);
+#else
+	if (!m_Crc16SlicesReady) crc16_init_slices();
+
+	// Bytes are read one at a time: data need not be word aligned
+	const unsigned char *p = (const unsigned char *)data;
+	unsigned short crc = 0;
+	for (; length >= CRC16_SLICE_BY; length -= CRC16_SLICE_BY, p += CRC16_SLICE_BY) {
+#  if CRC16_SLICE_BY == 8
+		crc = m_Crc16Slices[6][p[0] ^ (crc >> 8)] ^
+		      m_Crc16Slices[5][p[1] ^ (crc & 0xFF)] ^
+		      m_Crc16Slices[4][p[2]] ^ m_Crc16Slices[3][p[3]] ^
+		      m_Crc16Slices[2][p[4]] ^ m_Crc16Slices[1][p[5]] ^
+		      m_Crc16Slices[0][p[6]] ^ m_Crc16Table[p[7]];
+#  else
+		crc = m_Crc16Slices[2][p[0] ^ (crc >> 8)] ^
+		      m_Crc16Slices[1][p[1] ^ (crc & 0xFF)] ^
+		      m_Crc16Slices[0][p[2]] ^ m_Crc16Table[p[3]];
+#  endif
+	}
+	// Finish up byte at a time
+	while (length--) {
+		crc = (crc << 8) ^ m_Crc16Table[(crc >> 8) ^ *p++];
+	}
+	return crc;
+#endif
+}
+
 void update_crc16(unsigned short *pCrc16, const char data[], size_t length) {
 	for (size_t i = 0; i < length; i++) {
 		*pCrc16 = (*pCrc16 << 8) ^ m_Crc16Table[((*pCrc16 >> 8) ^ data[i]) & 0x00FF];
@@ -161,6 +161,7 @@ specific language governing permissions and limitations under the License.
 
 /* Standard includes. */
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 //
 #include "pico/mutex.h"
@@ -182,6 +183,43 @@ specific language governing permissions and limitations under the License.
 #if SD_CRC_ENABLED
 #include "crc.h"
 static bool crc_on = true;
+// Use the RP2040's DMA sniffer to compute data block CRCs
+#ifndef SD_CRC_USE_DMA_SNIFFER
+#define SD_CRC_USE_DMA_SNIFFER 1
+#endif
+#endif
+
+// In multiple block reads, verify the CRC of each block while the next block
+// is being received by DMA.
+#ifndef SD_READ_PIPELINING
+#define SD_READ_PIPELINING 1
+#endif
+static bool read_pipelining = SD_READ_PIPELINING;
+
+// Adaptive baud rate: see sd_adapt_baud_rate
+#ifndef SD_ADAPTIVE_BAUD_RATE
+#define SD_ADAPTIVE_BAUD_RATE 1
+#endif
+// Step the SPI clock down after this many errors without a clean window
+#ifndef SD_BAUD_ERROR_THRESHOLD
+#define SD_BAUD_ERROR_THRESHOLD 3
+#endif
+// Probe a faster SPI clock after this many transfers without error
+#ifndef SD_BAUD_CLEAN_WINDOW
+#define SD_BAUD_CLEAN_WINDOW 1000
+#endif
+#ifndef SD_BAUD_RATE_MIN
+#define SD_BAUD_RATE_MIN (1000 * 1000)
+#endif
+// Times a read or write is retried after a CRC or no response error
+#ifndef SD_IO_RETRIES
+#define SD_IO_RETRIES 3
+#endif
+
+// Close a write stream (see sd_card_t.write_streaming) that has been idle
+// this long when the next write comes
+#ifndef SD_STREAM_IDLE_TIMEOUT_MS
+#define SD_STREAM_IDLE_TIMEOUT_MS 1000
 #endif
 
 #define TRACE_PRINTF(fmt, args...)
@@ -307,7 +345,7 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
 
 #if SD_CRC_ENABLED
     if (crc_on) {
-        cmdPacket[5] = (crc7(cmdPacket, 5) << 1) | 0x01;
+        cmdPacket[5] = (crc7_cmd(cmdPacket) << 1) | 0x01;
     } else
 #endif
     {
@@ -450,6 +488,72 @@ static const char *cmd2str(const cmdSupported cmd) {
 #define SD_COMMAND_RETRIES 3 /*!< Times SPI cmd is retried when there is no response */
 #define SD_COMMAND_TIMEOUT 2000 /*!< Timeout in ms for response */
 
+// Wait for the card to finish programming, keeping count of the time spent
+static bool sd_wait_programmed(sd_card_t *pSD) {
+    absolute_time_t start = get_absolute_time();
+    bool ready = sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+    pSD->stats.busy_wait_us += absolute_time_diff_us(start, get_absolute_time());
+    return ready;
+}
+
+// Leave the card programming; the next command will wait for it
+// and then check its status
+static void sd_defer_busy(sd_card_t *pSD) {
+    pSD->busy_pending = true;
+    pSD->status_pending = true;
+    pSD->busy_since = get_absolute_time();
+    ++pSD->stats.busy_deferred;
+}
+
+// Pay for the last write-behind
+static bool sd_wait_deferred_busy(sd_card_t *pSD) {
+    pSD->stats.busy_overlap_us +=
+        absolute_time_diff_us(pSD->busy_since, get_absolute_time());
+    pSD->busy_pending = false;
+    return sd_wait_programmed(pSD);
+}
+
+static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                  bool isAcmd, uint32_t *resp);
+
+// Get the card's status after a write-behind, now that it has finished
+// programming, and hold on to any error for the next write or sync
+static void sd_check_deferred_status(sd_card_t *pSD) {
+    pSD->status_pending = false;
+    uint32_t stat = 0;
+    int status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        DBG_PRINTF("%s: write-behind failed: %d\r\n", __FUNCTION__, status);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == pSD->deferred_status)
+            pSD->deferred_status = status;
+    }
+}
+
+// Report an error latched by sd_check_deferred_status, unless there is
+// already one to report
+static int sd_take_deferred_status(sd_card_t *pSD, int status) {
+    int deferred = pSD->deferred_status;
+    pSD->deferred_status = SD_BLOCK_DEVICE_ERROR_NONE;
+    return status ? status : deferred;
+}
+
+static int sd_stream_close(sd_card_t *pSD);
+
+// Commands used in reading and writing blocks
+static bool sd_is_transfer_cmd(const cmdSupported cmd) {
+    switch (cmd) {
+        case CMD12_STOP_TRANSMISSION:
+        case CMD13_SEND_STATUS:
+        case CMD17_READ_SINGLE_BLOCK:
+        case CMD18_READ_MULTIPLE_BLOCK:
+        case CMD24_WRITE_BLOCK:
+        case CMD25_WRITE_MULTIPLE_BLOCK:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
                   bool isAcmd, uint32_t *resp) {
     TRACE_PRINTF("%s(%s(0x%08lx)): ", __FUNCTION__, cmd2str(cmd), arg);
@@ -457,11 +561,30 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response;
 
+    // Normally, streams are closed explicitly, so that errors get reported
+    if (SD_STREAM_NONE != pSD->stream && CMD12_STOP_TRANSMISSION != cmd) {
+        status = sd_stream_close(pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+            DBG_PRINTF("%s: closing stream failed: %d\r\n", __FUNCTION__, status);
+        status = SD_BLOCK_DEVICE_ERROR_NONE;
+    }
     // No need to wait for card to be ready when sending the stop command
     if (CMD12_STOP_TRANSMISSION != cmd) {
-        if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
+        bool ready;
+        if (pSD->busy_pending) {
+            ready = sd_wait_deferred_busy(pSD);
+        } else {
+            ready = sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+        }
+        if (false == ready) {
             DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
         }
+        if (pSD->status_pending) {
+            if (CMD13_SEND_STATUS == cmd)
+                pSD->status_pending = false;  // The caller gets the status
+            else
+                sd_check_deferred_status(pSD);
+        }
     }
     // Re-try command
     for (int i = 0; i < SD_COMMAND_RETRIES; i++) {
@@ -489,6 +612,10 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     if (R1_NO_RESPONSE == response) {
         DBG_PRINTF("No response CMD:%d response: 0x%" PRIx32 "\r\n", cmd,
                    response);
+        // Once the card is up, silence during a transfer is more likely a
+        // clock the card can't keep up with than a missing card
+        if (!isAcmd && sd_is_transfer_cmd(cmd))
+            return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
         return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;  // No device
     }
     if (response & R1_COM_CRC_ERROR && ACMD23_SET_WR_BLK_ERASE_COUNT != cmd) {
@@ -531,9 +658,12 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
             DBG_PRINTF("R3/R7: 0x%" PRIx32 "\r\n", response);
             break;
         case CMD12_STOP_TRANSMISSION:  // Response R1b
-        case CMD38_ERASE:
             sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
             break;
+        case CMD38_ERASE:  // Response R1b
+            // How long the card stays busy depends on how much is erased.
+            // See sd_erase_blocks.
+            break;
         case CMD13_SEND_STATUS:  // Response R2
             response <<= 8;
             response |= sd_spi_write(pSD, SPI_FILL_CHAR);
@@ -697,6 +827,21 @@ static uint32_t ext_bits(unsigned char *data, int msb, int lsb) {
 
 static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length);
 
+// Convert a CSD TRAN_SPEED to a clock rate in Hz
+static uint tran_speed_to_baud(uint32_t tran_speed) {
+    // Time values, times 10
+    static const uint8_t time_value[16] = {0,  10, 12, 13, 15, 20, 25, 30,
+                                           35, 40, 45, 50, 55, 60, 70, 80};
+    // Transfer rate units, divided by 10
+    static const uint32_t rate_unit[4] = {10 * 1000, 100 * 1000, 1000 * 1000,
+                                          10 * 1000 * 1000};
+    uint baud = 0;
+    if ((tran_speed & 0x7) < 4)
+        baud = rate_unit[tran_speed & 0x7] * time_value[(tran_speed >> 3) & 0xF];
+    // All SD cards support 25 MHz
+    return baud ? baud : 25 * 1000 * 1000;
+}
+
 static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
     uint32_t c_size, c_size_mult, read_bl_len;
     uint32_t block_len, mult, blocknr;
@@ -713,6 +858,8 @@ static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
         DBG_PRINTF("Couldn't read csd response from disk\r\n");
         return 0;
     }
+    pSD->max_baud_rate = tran_speed_to_baud(ext_bits(csd, 103, 96));  // TRAN_SPEED : csd[103:96]
+    pSD->ccc = ext_bits(csd, 95, 84);                                 // CCC : csd[95:84]
     // csd_structure : csd[127:126]
     int csd_structure = ext_bits(csd, 127, 126);
     switch (csd_structure) {
@@ -759,6 +906,58 @@ uint64_t sd_sectors(sd_card_t *pSD) {
     return sectors;
 }
 
+/* Get the allocation unit size and erase timing from the SD Status.
+ * Leaves them zero if they are unknown. */
+static void sd_read_sd_status(sd_card_t *pSD) {
+    // AU_SIZE code to AU size in 512 byte sectors
+    static const uint32_t au_sectors[16] = {
+        0,     32,    64,    128,   256,   512,   1024,  2048,
+        4096,  8192,  16384, 24576, 32768, 49152, 65536, 131072};
+    uint8_t status[64];  // 512 bits; byte 0 holds bits 511:504
+
+    pSD->au_size = 0;
+    pSD->erase_size = 0;
+    pSD->erase_timeout = 0;
+    pSD->erase_offset = 0;
+    // Version 1 cards have no SD Status
+    if (SDCARD_V1 == pSD->card_type) return;
+    if (SD_BLOCK_DEVICE_ERROR_NONE !=
+            sd_cmd(pSD, ACMD13_SD_STATUS, 0, true, 0) ||
+        SD_BLOCK_DEVICE_ERROR_NONE != sd_read_bytes(pSD, status, sizeof status)) {
+        DBG_PRINTF("Couldn't read SD Status\r\n");
+        return;
+    }
+    pSD->au_size = au_sectors[status[10] >> 4];                // [431:428]
+    pSD->erase_size = (status[11] << 8) | status[12];          // [423:408]
+    pSD->erase_timeout = status[13] >> 2;                      // [407:402]
+    pSD->erase_offset = status[13] & 0x3;                      // [401:400]
+    DBG_PRINTF("AU size: %lu sectors; erase size: %u AUs, timeout: %u s, "
+               "offset: %u s\r\n",
+               (unsigned long)pSD->au_size, pSD->erase_size,
+               pSD->erase_timeout, pSD->erase_offset);
+}
+
+/* Switch the card to High-Speed mode (up to 50 MHz) with CMD6, if it can.
+ * Returns true if it switched. */
+static bool sd_switch_high_speed(sd_card_t *pSD) {
+    uint8_t status[64];  // Switch function status; byte 0 holds bits 511:504
+
+    // Switch function is command class 10
+    if (!(pSD->ccc & (1 << 10))) return false;
+    // Check function: is High-Speed (function 1 of group 1) supported?
+    if (SD_BLOCK_DEVICE_ERROR_NONE !=
+            sd_cmd(pSD, CMD6_SWITCH_FUNC, 0x00FFFFF1, false, 0) ||
+        SD_BLOCK_DEVICE_ERROR_NONE != sd_read_bytes(pSD, status, sizeof status))
+        return false;
+    if (!(status[13] & 0x02)) return false;  // Group 1 support bits: [415:400]
+    // Switch function
+    if (SD_BLOCK_DEVICE_ERROR_NONE !=
+            sd_cmd(pSD, CMD6_SWITCH_FUNC, 0x80FFFFF1, false, 0) ||
+        SD_BLOCK_DEVICE_ERROR_NONE != sd_read_bytes(pSD, status, sizeof status))
+        return false;
+    return 1 == (status[16] & 0xF);  // Group 1 function selected: [379:376]
+}
+
 // SPI function to wait till chip is ready and sends start token
 static bool sd_wait_token(sd_card_t *pSD, uint8_t token) {
     TRACE_PRINTF("%s(0x%02hhx)\r\n", __FUNCTION__, token);
@@ -809,6 +1008,38 @@ static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
 
     return 0;
 }
+#if SD_CRC_ENABLED
+// Returns true if the DMA sniffer will compute the CRC16 of the next
+// data block transfer. Otherwise, it's up to the CPU.
+static bool sd_crc_sniff_start(sd_card_t *pSD, bool tx) {
+#if SD_CRC_USE_DMA_SNIFFER
+    return crc_on && spi_crc16_sniff_start(pSD->spi, tx);
+#else
+    (void)pSD;
+    (void)tx;
+    return false;
+#endif
+}
+
+#ifdef SD_CRC_ERROR_INJECTION
+// Corrupt the CRC of one in this many blocks received (0: none)
+static uint32_t crc_error_injection;
+#endif
+
+static bool sd_check_crc(uint16_t crc_result, uint16_t crc) {
+#ifdef SD_CRC_ERROR_INJECTION
+    if (crc_error_injection && 0 == rand() % crc_error_injection) crc ^= 1;
+#endif
+    if (crc_result != crc) {
+        DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
+                   " result of computation 0x%" PRIx16 "\r\n",
+                   __FUNCTION__, crc, crc_result);
+        return false;
+    }
+    return true;
+}
+#endif
+
 static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     uint16_t crc;
 
@@ -817,9 +1048,16 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
         DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
+#if SD_CRC_ENABLED
+    bool sniffed = sd_crc_sniff_start(pSD, false);
+#endif
     // read data
     // bool spi_transfer(const uint8_t *tx, uint8_t *rx, size_t length)
-    if (!sd_spi_transfer(pSD, NULL, buffer, length)) {
+    bool ok = sd_spi_transfer(pSD, NULL, buffer, length);
+#if SD_CRC_ENABLED
+    uint16_t crc_result = sniffed ? spi_crc16_sniff_finish(pSD->spi) : 0;
+#endif
+    if (!ok) {
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
     // Read the CRC16 checksum for the data block
@@ -828,21 +1066,102 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
 
 #if SD_CRC_ENABLED
     if (crc_on) {
-        uint32_t crc_result;
-        // Compute and verify checksum
-        crc_result = crc16((void *)buffer, length);
-        if ((uint16_t)crc_result != crc) {
-            DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
-                       " result of computation 0x%" PRIx16 "\r\n",
-                       __FUNCTION__, crc, (uint16_t)crc_result);
+        if (!sniffed) crc_result = crc16((void *)buffer, length);
+        if (!sd_check_crc(crc_result, crc))
             return SD_BLOCK_DEVICE_ERROR_CRC;
-        }
     }
 #endif
 
     return SD_BLOCK_DEVICE_ERROR_NONE;
 }
 
+#if SD_CRC_ENABLED
+/* Receive the data blocks of a multiple block read.
+ * If the DMA sniffer is available, it computes the CRC as the data comes in.
+ * Otherwise, the CRC of block N is computed and verified while the DMA is
+ * receiving block N+1, so the CRC computation does not leave the bus idle. */
+static int sd_read_blocks_pipelined(sd_card_t *pSD, uint8_t *buffer,
+                                    uint32_t blockCnt) {
+    const uint8_t *prev = NULL;  // Received block awaiting verification
+    uint16_t prev_crc = 0;
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+    for (; blockCnt; --blockCnt, buffer += _block_size) {
+        // read until start byte (0xFE)
+        if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
+            DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
+            return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        }
+        bool sniffed = sd_crc_sniff_start(pSD, false);
+        // Start receiving this block...
+        bool ok = sd_spi_transfer_start(pSD, NULL, buffer, _block_size);
+        // ...and meanwhile, verify the previous one
+        if (ok && prev && !sd_check_crc(crc16((void *)prev, _block_size), prev_crc))
+            status = SD_BLOCK_DEVICE_ERROR_CRC;
+        ok = ok && sd_spi_transfer_wait_complete(pSD, 1000);
+        uint16_t crc_result = sniffed ? spi_crc16_sniff_finish(pSD->spi) : 0;
+        if (!ok)
+            return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+            return status;
+        // Read the CRC16 checksum for the data block
+        uint16_t crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
+        crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
+        if (sniffed) {
+            if (!sd_check_crc(crc_result, crc))
+                return SD_BLOCK_DEVICE_ERROR_CRC;
+            prev = NULL;
+        } else {
+            prev = buffer;
+            prev_crc = crc;
+        }
+    }
+    // Verify the last block
+    if (prev && !sd_check_crc(crc16((void *)prev, _block_size), prev_crc))
+        status = SD_BLOCK_DEVICE_ERROR_CRC;
+    return status;
+}
+#endif
+
+bool set_sd_read_pipelining(bool enable) {
+    bool prev = read_pipelining;
+    read_pipelining = enable;
+    return prev;
+}
+
+#ifdef SD_CRC_ERROR_INJECTION
+void set_sd_crc_error_injection(uint32_t one_in) {
+#if SD_CRC_ENABLED
+    crc_error_injection = one_in;
+#else
+    (void)one_in;
+#endif
+}
+#endif
+
+// Receive the data of a read command
+static int sd_read_data(sd_card_t *pSD, uint8_t *buffer, uint32_t blockCnt) {
+    // receive the data : one block at a time
+    int rd_status = 0;
+#if SD_CRC_ENABLED
+    if (crc_on && read_pipelining && blockCnt > 1) {
+        rd_status = sd_read_blocks_pipelined(pSD, buffer, blockCnt);
+    } else
+#endif
+    {
+        while (blockCnt) {
+            rd_status = sd_read_block(pSD, buffer, _block_size);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rd_status) break;
+            buffer += _block_size;
+            --blockCnt;
+        }
+    }
+    return rd_status;
+}
+
+static int sd_stream_close(sd_card_t *pSD);
+static bool sd_stream_idle(sd_card_t *pSD);
+
 static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
                              uint64_t ulSectorNumber, uint32_t ulSectorCount) {
     uint32_t blockCnt = ulSectorCount;
@@ -853,69 +1172,164 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
         return SD_BLOCK_DEVICE_ERROR_PARAMETER;
 
     int status = SD_BLOCK_DEVICE_ERROR_NONE;
-
-    uint64_t addr;
-    // SDSC Card (CCS=0) uses byte unit address
-    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
-    if (SDCARD_V2HC == pSD->card_type) {
-        addr = ulSectorNumber;
+    bool multiple;   // CMD18 in progress: it must be stopped or left open
+    bool streaming;  // Leave it open for the next read
+    // Don't leave the card reading past its end
+    bool more = ulSectorNumber + blockCnt < pSD->sectors;
+
+    ++pSD->stats.reads;
+    if (SD_STREAM_READ == pSD->stream &&
+        ulSectorNumber == pSD->stream_next_sector && !sd_stream_idle(pSD)) {
+        // Read-ahead hit: the card is waiting to send the next block
+        ++pSD->stats.read_stream_hits;
+        multiple = true;
+        streaming = more;
     } else {
-        addr = ulSectorNumber * _block_size;
-    }
-    // Write command ro receive data
-    if (blockCnt > 1) {
-        status = sd_cmd(pSD, CMD18_READ_MULTIPLE_BLOCK, addr, false, 0);
-    } else {
-        status = sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK, addr, false, 0);
-    }
-    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
-        return status;
-    }
-    // receive the data : one block at a time
-    int rd_status = 0;
-    while (blockCnt) {
-        if (0 != sd_read_block(pSD, buffer, _block_size)) {
-            rd_status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
-            break;
+        // Report any error from finishing a write stream
+        status = sd_stream_close(pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+
+        // A sequential read is likely to be followed by another
+        streaming =
+            pSD->read_ahead && ulSectorNumber == pSD->last_read_end && more;
+        multiple = blockCnt > 1 || streaming;
+
+        uint64_t addr;
+        // SDSC Card (CCS=0) uses byte unit address
+        // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+        if (SDCARD_V2HC == pSD->card_type) {
+            addr = ulSectorNumber;
+        } else {
+            addr = ulSectorNumber * _block_size;
         }
-        buffer += _block_size;
-        --blockCnt;
+        // Write command ro receive data
+        if (multiple) {
+            status = sd_cmd(pSD, CMD18_READ_MULTIPLE_BLOCK, addr, false, 0);
+        } else {
+            status = sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK, addr, false, 0);
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            return status;
+        }
+        if (streaming) ++pSD->stats.read_streams_opened;
+    }
+    pSD->last_read_end = ulSectorNumber + blockCnt;
+    int rd_status = sd_read_data(pSD, buffer, blockCnt);
+    if (streaming && !rd_status) {
+        // Leave the transmission open for the next read
+        pSD->stream = SD_STREAM_READ;
+        pSD->stream_next_sector = pSD->last_read_end;
+        pSD->stream_last_use = get_absolute_time();
+        return SD_BLOCK_DEVICE_ERROR_NONE;
     }
+    pSD->stream = SD_STREAM_NONE;
     // Send CMD12(0x00000000) to stop the transmission for multi-block transfer
-    if (ulSectorCount > 1) {
+    if (multiple) {
         status = sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
     }
     return rd_status ? rd_status : status;
 }
 
+/* Adaptive baud rate:
+ * Step the SPI clock down when transfer errors (CRC, no response) add up,
+ * and probe back up after a run of clean transfers. */
+static void sd_set_baud_rate(sd_card_t *pSD, uint baud_rate) {
+    pSD->baud_rate = baud_rate;
+    sd_spi_go_high_frequency(pSD);  // Sets pSD->baud_rate to the actual rate
+    DBG_PRINTF("%s: SPI clock now %u Hz\r\n", pSD->pcName, pSD->baud_rate);
+}
+static void sd_adapt_baud_rate(sd_card_t *pSD, int status) {
+    if (!pSD->baud_rate) return;  // Not negotiated
+    switch (status) {
+        case SD_BLOCK_DEVICE_ERROR_CRC:
+        case SD_BLOCK_DEVICE_ERROR_NO_RESPONSE:
+            if (SD_BLOCK_DEVICE_ERROR_CRC == status)
+                ++pSD->stats.crc_errors;
+            else
+                ++pSD->stats.no_response_errors;
+            pSD->clean_transfers = 0;
+            if (++pSD->recent_errors < SD_BAUD_ERROR_THRESHOLD) break;
+            pSD->recent_errors = 0;
+            if (pSD->baud_rate > SD_BAUD_RATE_MIN) {
+                uint baud_rate = pSD->baud_rate * 3 / 4;
+                sd_set_baud_rate(pSD, baud_rate > SD_BAUD_RATE_MIN ? baud_rate
+                                                                   : SD_BAUD_RATE_MIN);
+                ++pSD->stats.baud_rate_steps_down;
+            }
+            break;
+        case SD_BLOCK_DEVICE_ERROR_NONE: {
+            if (++pSD->clean_transfers < SD_BAUD_CLEAN_WINDOW) break;
+            pSD->clean_transfers = 0;
+            pSD->recent_errors = 0;
+            uint ceiling = pSD->spi->baud_rate < pSD->max_baud_rate
+                               ? pSD->spi->baud_rate
+                               : pSD->max_baud_rate;
+            if (pSD->baud_rate >= ceiling) break;
+            uint old_baud_rate = pSD->baud_rate;
+            uint baud_rate = pSD->baud_rate * 4 / 3;
+            sd_set_baud_rate(pSD, baud_rate < ceiling ? baud_rate : ceiling);
+            // The SPI clock divider is coarse: make sure it actually went up
+            if (pSD->baud_rate <= old_baud_rate) sd_set_baud_rate(pSD, ceiling);
+            ++pSD->stats.baud_rate_steps_up;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/* Keep track of the outcome of a transfer.
+ * Returns true if it failed in a way that's worth retrying. */
+static bool sd_io_retry(sd_card_t *pSD, int status, int *retries_p) {
+#if SD_ADAPTIVE_BAUD_RATE
+    sd_adapt_baud_rate(pSD, status);
+#endif
+    return (SD_BLOCK_DEVICE_ERROR_CRC == status ||
+            SD_BLOCK_DEVICE_ERROR_NO_RESPONSE == status) &&
+           (*retries_p)-- > 0;
+}
+
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount) {
     sd_acquire(pSD);
     TRACE_PRINTF("sd_read_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, ulSectorCount);
-    int status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    int status;
+    int retries = SD_IO_RETRIES;
+    do {
+        status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    } while (sd_io_retry(pSD, status, &retries));
     sd_release(pSD);
     return status;
 }
 
 static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
-                              uint8_t token, uint32_t length) {
+                              uint8_t token, uint32_t length, bool wait) {
     uint16_t crc = (~0);
     uint8_t response = 0xFF;
 
     // indicate start of block
     sd_spi_write(pSD, token);
 
+#if SD_CRC_ENABLED
+    bool sniffed = sd_crc_sniff_start(pSD, true);
+#endif
     // write the data
-    bool ret = sd_spi_transfer(pSD, buffer, NULL, length);
+    bool ret = sd_spi_transfer_start(pSD, buffer, NULL, length);
     myASSERT(ret);
 
 #if SD_CRC_ENABLED
-    if (crc_on) {
-        // Compute CRC
+    if (crc_on && !sniffed) {
+        // Compute CRC while the DMA is sending the data.
+        // The CRC isn't needed until the data has all gone out.
         crc = crc16((void *)buffer, length);
     }
 #endif
+    ret = sd_spi_transfer_wait_complete(pSD, 1000);
+    myASSERT(ret);
+#if SD_CRC_ENABLED
+    if (sniffed) crc = spi_crc16_sniff_finish(pSD->spi);
+#endif
 
     // write the checksum CRC16
     sd_spi_write(pSD, crc >> 8);
@@ -925,7 +1339,7 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
     response = sd_spi_write(pSD, SPI_FILL_CHAR);
 
     // Wait for last block to be written
-    if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
+    if (wait && false == sd_wait_programmed(pSD)) {
         DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
     }
     return (response & SPI_DATA_RESPONSE_MASK);
@@ -946,6 +1360,33 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
  *                  SD_BLOCK_DEVICE_ERROR_WRITE - SPI write error
  *                  SD_BLOCK_DEVICE_ERROR_ERASE - erase error
  */
+/* Finish a write: get the card's status when it's done programming */
+static int sd_write_finish(sd_card_t *pSD, int status) {
+    if (pSD->write_behind) {
+        // Don't wait for the card to finish programming.
+        // CMD13 would have to, so the status check is left to the next
+        // command (see sd_cmd) or sync.
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+            sd_defer_busy(pSD);
+        } else {
+            sd_wait_programmed(pSD);
+        }
+        return status;
+    }
+    uint32_t stat = 0;
+    // Some SD cards want to be deselected between every bus transaction:
+    sd_spi_deselect_pulse(pSD);
+    int cmd13_status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    // Don't lose an earlier error
+    return status ? status : cmd13_status;
+}
+
+// Status for a data response token that isn't SPI_DATA_ACCEPTED
+static int sd_data_response_status(uint8_t response) {
+    if (SPI_DATA_CRC_ERROR == response) return SD_BLOCK_DEVICE_ERROR_CRC;
+    return SD_BLOCK_DEVICE_ERROR_WRITE;
+}
+
 static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
                               uint64_t ulSectorNumber, uint32_t blockCnt) {
     if (ulSectorNumber + blockCnt > pSD->sectors)
@@ -972,12 +1413,13 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
             return status;
         }
         // Write data
-        response = sd_write_block(pSD, buffer, SPI_START_BLOCK, _block_size);
+        response = sd_write_block(pSD, buffer, SPI_START_BLOCK, _block_size,
+                                  !pSD->write_behind);
 
         // Only CRC and general write error are communicated via response token
         if (response != SPI_DATA_ACCEPTED) {
             DBG_PRINTF("Single Block Write failed: 0x%x \r\n", response);
-            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+            status = sd_data_response_status(response);
         }
     } else {
         // Pre-erase setting prior to multiple block write operation
@@ -993,10 +1435,12 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
         }
         // Write the data: one block at a time
         do {
-            response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE, _block_size);
+            // The card must be done with each block before the next token
+            response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE,
+                                      _block_size, true);
             if (response != SPI_DATA_ACCEPTED) {
                 DBG_PRINTF("Multiple Block Write failed: 0x%x\r\n", response);
-                status = SD_BLOCK_DEVICE_ERROR_WRITE;
+                status = sd_data_response_status(response);
                 break;
             }
             buffer += _block_size;
@@ -1007,10 +1451,100 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
          */
         sd_spi_write(pSD, SPI_STOP_TRAN);
     }
-    uint32_t stat = 0;
-    // Some SD cards want to be deselected between every bus transaction:
-    sd_spi_deselect_pulse(pSD);
-    status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    return sd_write_finish(pSD, status);
+}
+
+/* Close an open read or write stream.
+ * Like Stop Tran, any other command can only be sent after the card has
+ * finished programming the last block written, so this waits for that first. */
+static int sd_stream_close(sd_card_t *pSD) {
+    sd_stream_t stream = pSD->stream;
+    pSD->stream = SD_STREAM_NONE;
+    switch (stream) {
+        case SD_STREAM_WRITE:
+            if (pSD->busy_pending) sd_wait_deferred_busy(pSD);
+            sd_spi_write(pSD, SPI_STOP_TRAN);
+            return sd_write_finish(pSD, SD_BLOCK_DEVICE_ERROR_NONE);
+        case SD_STREAM_READ:
+            ++pSD->stats.read_stream_misses;
+            return sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
+        default:
+            return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+}
+
+// Has the stream gone unused for too long?
+static bool sd_stream_idle(sd_card_t *pSD) {
+    return absolute_time_diff_us(pSD->stream_last_use, get_absolute_time()) >
+           SD_STREAM_IDLE_TIMEOUT_MS * 1000;
+}
+
+/* Write to the open stream, if the sectors follow on from it.
+ * Otherwise, close it and open a new one starting at ulSectorNumber. */
+static int sd_stream_write(sd_card_t *pSD, const uint8_t *buffer,
+                           uint64_t ulSectorNumber, uint32_t blockCnt) {
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+    if (SD_STREAM_NONE != pSD->stream &&
+        (SD_STREAM_WRITE != pSD->stream ||
+         ulSectorNumber != pSD->stream_next_sector || sd_stream_idle(pSD))) {
+        status = sd_stream_close(pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    }
+    if (SD_STREAM_WRITE == pSD->stream) {
+        ++pSD->stats.stream_writes;
+        // The card must finish programming the previous block
+        // before it can take the next one
+        if (pSD->busy_pending) sd_wait_deferred_busy(pSD);
+    } else {
+        uint64_t addr;
+        if (SDCARD_V2HC == pSD->card_type) {
+            addr = ulSectorNumber;
+        } else {
+            addr = ulSectorNumber * _block_size;
+        }
+        // Open-ended: no ACMD23, since the number of blocks is unknown
+        status = sd_cmd(pSD, CMD25_WRITE_MULTIPLE_BLOCK, addr, false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+        pSD->stream = SD_STREAM_WRITE;
+        ++pSD->stats.streams_opened;
+    }
+    do {
+        // With write-behind, the card can still be programming the last
+        // block when we return
+        bool wait = blockCnt > 1 || !pSD->write_behind;
+        uint8_t response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE,
+                                          _block_size, wait);
+        if (response != SPI_DATA_ACCEPTED) {
+            DBG_PRINTF("Stream Block Write failed: 0x%x\r\n", response);
+            if (!wait) sd_wait_programmed(pSD);
+            pSD->stream = SD_STREAM_NONE;
+            sd_spi_write(pSD, SPI_STOP_TRAN);
+            return sd_write_finish(pSD, sd_data_response_status(response));
+        }
+        buffer += _block_size;
+        ++ulSectorNumber;
+    } while (--blockCnt);
+    if (pSD->write_behind) sd_defer_busy(pSD);
+    pSD->stream_next_sector = ulSectorNumber;
+    pSD->stream_last_use = get_absolute_time();
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int sd_write_blocks_once(sd_card_t *pSD, const uint8_t *buffer,
+                                uint64_t ulSectorNumber, uint32_t blockCnt) {
+    int status;
+    if (pSD->write_streaming) {
+        if (ulSectorNumber + blockCnt > pSD->sectors ||
+            pSD->m_Status & (STA_NOINIT | STA_NODISK))
+            status = SD_BLOCK_DEVICE_ERROR_PARAMETER;
+        else
+            status = sd_stream_write(pSD, buffer, ulSectorNumber, blockCnt);
+    } else {
+        status = sd_stream_close(pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    }
     return status;
 }
 
@@ -1019,7 +1553,80 @@ int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     sd_acquire(pSD);
     TRACE_PRINTF("sd_write_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, blockCnt);
-    int status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    int status;
+    int retries = SD_IO_RETRIES;
+    do {
+        status = sd_write_blocks_once(pSD, buffer, ulSectorNumber, blockCnt);
+    } while (sd_io_retry(pSD, status, &retries));
+    // An earlier write-behind may have failed
+    status = sd_take_deferred_status(pSD, status);
+    sd_release(pSD);
+    return status;
+}
+
+// Time to allow for erasing blockCnt blocks
+static uint32_t sd_erase_timeout_ms(sd_card_t *pSD, uint64_t blockCnt) {
+    if (pSD->au_size && pSD->erase_size && pSD->erase_timeout) {
+        // Per the SD Status: erasing ERASE_SIZE AUs takes at most
+        // ERASE_TIMEOUT seconds, plus ERASE_OFFSET seconds
+        uint64_t aus = (blockCnt + pSD->au_size - 1) / pSD->au_size;
+        return SD_COMMAND_TIMEOUT + pSD->erase_offset * 1000 +
+               (uint32_t)(aus * pSD->erase_timeout * 1000 / pSD->erase_size);
+    }
+    // Otherwise, allow 250 ms for every 4 MiB (a typical allocation unit)
+    return SD_COMMAND_TIMEOUT + 250 * (uint32_t)(blockCnt / 8192 + 1);
+}
+
+/* Erase blocks ulStartSector through ulEndSector (inclusive).
+ * Afterwards, the card can reuse the flash without first having to preserve
+ * the data, so later writes there are faster. */
+static int sd_erase_blocks(sd_card_t *pSD, uint64_t ulStartSector,
+                           uint64_t ulEndSector) {
+    sd_acquire(pSD);
+    TRACE_PRINTF("sd_erase_blocks(0x%llx, 0x%llx)\r\n", ulStartSector,
+                 ulEndSector);
+    if (ulStartSector > ulEndSector || ulEndSector >= pSD->sectors ||
+        pSD->m_Status & (STA_NOINIT | STA_NODISK)) {
+        sd_release(pSD);
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+    uint64_t start = ulStartSector, end = ulEndSector;
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    if (SDCARD_V2HC != pSD->card_type) {
+        start *= _block_size;
+        end *= _block_size;
+    }
+    int status = sd_stream_close(pSD);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(pSD, CMD32_ERASE_WR_BLK_START_ADDR, start, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(pSD, CMD33_ERASE_WR_BLK_END_ADDR, end, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(pSD, CMD38_ERASE, 0, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        uint32_t timeout =
+            sd_erase_timeout_ms(pSD, ulEndSector - ulStartSector + 1);
+        if (!sd_wait_ready(pSD, timeout)) {
+            DBG_PRINTF("%s: erase timed out after %lu ms\r\n", __FUNCTION__,
+                       (unsigned long)timeout);
+            status = SD_BLOCK_DEVICE_ERROR_ERASE;
+        }
+    }
+    sd_release(pSD);
+    return status;
+}
+
+static int sd_sync(sd_card_t *pSD) {
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    sd_acquire(pSD);
+    status = sd_stream_close(pSD);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status && pSD->status_pending) {
+        // Waits for the card to finish programming, then gets its status
+        uint32_t stat = 0;
+        status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    }
+    status = sd_take_deferred_status(pSD, status);
     sd_release(pSD);
     return status;
 }
@@ -1137,7 +1744,14 @@ static void sd_ctor(sd_card_t *pSD) {
     pSD->init = sd_init;
     pSD->write_blocks = sd_write_blocks;
     pSD->read_blocks = sd_read_blocks;
+    pSD->sync = sd_sync;
+    pSD->erase_blocks = sd_erase_blocks;
     pSD->sd_test_com = sd_test_com;
+    pSD->busy_pending = false;
+    pSD->status_pending = false;
+    pSD->deferred_status = SD_BLOCK_DEVICE_ERROR_NONE;
+    pSD->stream = SD_STREAM_NONE;
+    pSD->last_read_end = UINT64_MAX;
 }
 bool sd_init_driver() {
     static bool initialized;
@@ -1199,6 +1813,12 @@ static int sd_init(sd_card_t *pSD) {
     }
     // Initialize the member variables
     pSD->card_type = SDCARD_NONE;
+    // Whatever the card was doing, it is about to be reset
+    pSD->baud_rate = 0;
+    pSD->busy_pending = false;
+    pSD->status_pending = false;
+    pSD->deferred_status = SD_BLOCK_DEVICE_ERROR_NONE;
+    pSD->stream = SD_STREAM_NONE;
 
     sd_spi_acquire(pSD);
 
@@ -1224,8 +1844,21 @@ static int sd_init(sd_card_t *pSD) {
         sd_unlock(pSD);
         return pSD->m_Status;
     }
+    sd_read_sd_status(pSD);
+
+    // Run as fast as both the card and the SPI (baud_rate is a ceiling) allow.
+    // Cards start out at up to 25 MHz; High-Speed mode allows up to 50.
+    if (pSD->spi->baud_rate > pSD->max_baud_rate && sd_switch_high_speed(pSD)) {
+        DBG_PRINTF("Switched to High-Speed mode\r\n");
+        // The CSD TRAN_SPEED now reflects High-Speed mode
+        sd_sectors_nolock(pSD);
+    }
+    pSD->baud_rate = pSD->spi->baud_rate < pSD->max_baud_rate
+                         ? pSD->spi->baud_rate
+                         : pSD->max_baud_rate;
     // Set SCK for data transfer
     sd_spi_go_high_frequency(pSD);
+    DBG_PRINTF("SPI clock: %u Hz\r\n", pSD->baud_rate);
 
     // The card is now initialized
     pSD->m_Status &= ~STA_NOINIT;
@@ -1246,6 +1879,9 @@ static bool sd_test_com(sd_card_t *pSD) {
     bool success = false;
 
     if (!(pSD->m_Status & STA_NOINIT)) {
+        // Get the card out of any multiple block write
+        sd_stream_close(pSD);
+
         // SD card is currently initialized
 
         // Timeout of 0 means only check once
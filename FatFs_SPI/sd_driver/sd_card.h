@@ -32,6 +32,35 @@ extern "C" {
 
 typedef struct sd_card_t sd_card_t;
 
+// Multiple block transfer left open between calls
+typedef enum {
+    SD_STREAM_NONE,
+    SD_STREAM_WRITE,  // CMD25: see write_streaming
+    SD_STREAM_READ    // CMD18: see read_ahead
+} sd_stream_t;
+
+// Performance counters, kept per card
+typedef struct {
+    uint32_t busy_deferred;    // Writes that returned before the card finished programming
+    uint64_t busy_wait_us;     // Time spent waiting for the card to finish programming
+    uint64_t busy_overlap_us;  // Time between deferred writes returning and the next command:
+                               //   an upper bound on the programming time hidden from the caller
+    uint32_t streams_opened;   // Write streams (CMD25) opened
+    uint32_t stream_writes;    // Writes that continued an open write stream
+    uint32_t reads;            // Calls to read_blocks
+    uint32_t read_streams_opened;  // Read streams (CMD18) left open for read-ahead
+    uint32_t read_stream_hits;     // Reads that continued an open read stream
+    uint32_t read_stream_misses;   // Read streams closed without being continued
+    uint32_t crc_errors;           // Reads and writes that failed with CRC errors
+    uint32_t no_response_errors;   // Reads and writes that failed with no response
+    uint32_t baud_rate_steps_down;
+    uint32_t baud_rate_steps_up;
+    uint32_t cache_hits;           // Sector cache (see DISK_CACHE_SECTORS in glue.c)
+    uint32_t cache_misses;
+    uint32_t cache_write_backs;    // Dirty sectors written to the card
+    uint32_t cache_discards;       // Dirty sectors dropped on (re)initialization
+} sd_card_stats_t;
+
 // "Class" representing SD Cards
 struct sd_card_t {
     const char *pcName;
@@ -46,20 +75,56 @@ struct sd_card_t {
     // GPIO_DRIVE_STRENGTH_12MA = 3 }
     bool set_drive_strength;
     enum gpio_drive_strength ss_gpio_drive_strength;
+    // Return from writes as soon as the card accepts the data,
+    // instead of waiting for it to finish programming. The wait is
+    // paid by the next command to the card, or by sync.
+    bool write_behind;
+    // Keep a multiple block write (CMD25) open across writes to consecutive
+    // sectors. It is closed by a write elsewhere, a read, sync, or when a
+    // write comes after it has been idle for SD_STREAM_IDLE_TIMEOUT_MS.
+    bool write_streaming;
+    // When reads are sequential, leave the multiple block read (CMD18) open,
+    // so that the next read can carry on without a command. Any other access
+    // closes it.
+    bool read_ahead;
 
     // Following fields are used to keep track of the state of the card:
     int m_Status;                                    // Card status
     uint64_t sectors;                                // Assigned dynamically
     int card_type;                                   // Assigned dynamically
+    uint16_t ccc;            // Card Command Classes, from the CSD
+    uint max_baud_rate;      // Card's maximum SPI clock, from the CSD TRAN_SPEED
+    uint baud_rate;          // SPI clock in use: the lesser of max_baud_rate and spi->baud_rate
+    // From the SD Status (0 if unknown):
+    uint32_t au_size;        // Allocation unit size in sectors
+    uint16_t erase_size;     // Number of AUs erased in erase_timeout
+    uint8_t erase_timeout;   // Seconds
+    uint8_t erase_offset;    // Seconds
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    bool busy_pending;             // Card may still be programming a write-behind
+    absolute_time_t busy_since;    // When the write-behind returned
+    bool status_pending;           // The write-behind's status is yet to be checked (CMD13)
+    int deferred_status;           // Error from a write-behind, for the next write or sync
+    sd_stream_t stream;            // Multiple block transfer in progress
+    uint64_t stream_next_sector;   // Sector that would continue the stream
+    absolute_time_t stream_last_use;
+    uint64_t last_read_end;        // Sector following the last read
+    uint32_t recent_errors;        // For the adaptive baud rate
+    uint32_t clean_transfers;      // For the adaptive baud rate
+    sd_card_stats_t stats;
 
     int (*init)(sd_card_t *sd_card_p);
     int (*write_blocks)(sd_card_t *sd_card_p, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt);
     int (*read_blocks)(sd_card_t *sd_card_p, uint8_t *buffer, uint64_t ulSectorNumber,
                     uint32_t ulSectorCount);
+    // Wait for any writes in progress to complete and report their status
+    int (*sync)(sd_card_t *sd_card_p);
+    // Erase the blocks from ulStartSector to ulEndSector, inclusive
+    int (*erase_blocks)(sd_card_t *sd_card_p, uint64_t ulStartSector,
+                        uint64_t ulEndSector);
 
     // Useful when use_card_detect is false - call periodically to check for presence of SD card
     // Returns true if and only if SD card was sensed on the bus
@@ -93,6 +158,14 @@ uint64_t sd_sectors(sd_card_t *pSD);
 bool sd_init_driver();
 bool sd_card_detect(sd_card_t *sd_card_p);
 
+// Overlap CRC verification with DMA in multiple block reads
+// (default: SD_READ_PIPELINING). Returns the previous setting.
+bool set_sd_read_pipelining(bool enable);
+#ifdef SD_CRC_ERROR_INJECTION
+// For testing: corrupt the CRC of one in one_in received blocks (0: none)
+void set_sd_crc_error_injection(uint32_t one_in);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
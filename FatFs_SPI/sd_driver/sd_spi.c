@@ -30,9 +30,12 @@ specific language governing permissions and limitations under the License.
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
+// Go to the baud rate negotiated with the card, if any
 void sd_spi_go_high_frequency(sd_card_t *pSD) {
-    uint actual = spi_set_baudrate(pSD->spi->hw_inst, pSD->spi->baud_rate);
+    uint baud_rate = pSD->baud_rate ? pSD->baud_rate : pSD->spi->baud_rate;
+    uint actual = spi_set_baudrate(pSD->spi->hw_inst, baud_rate);
     TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    if (pSD->baud_rate) pSD->baud_rate = actual;
 }
 void sd_spi_go_low_frequency(sd_card_t *pSD) {
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
@@ -78,6 +81,9 @@ void sd_spi_deselect_pulse(sd_card_t *pSD) {
 }
 void sd_spi_acquire(sd_card_t *pSD) {
     sd_spi_lock(pSD);
+    // Cards sharing an SPI can run at different speeds
+    if (pSD->baud_rate && spi_get_baudrate(pSD->spi->hw_inst) != pSD->baud_rate)
+        sd_spi_go_high_frequency(pSD);
     sd_spi_select(pSD);
 }
 
@@ -90,6 +96,13 @@ bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
                      size_t length) {
     return spi_transfer(pSD->spi, tx, rx, length);
 }
+bool sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                           size_t length) {
+    return spi_transfer_async(pSD->spi, tx, rx, length, NULL, NULL);
+}
+bool sd_spi_transfer_wait_complete(sd_card_t *pSD, uint32_t timeout_ms) {
+    return spi_transfer_wait_idle(pSD->spi, timeout_ms);
+}
 
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value) {
     // TRACE_PRINTF("%s\n", __FUNCTION__);
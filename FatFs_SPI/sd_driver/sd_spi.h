@@ -21,6 +21,10 @@ specific language governing permissions and limitations under the License.
 /* Transfer tx to SPI while receiving SPI to rx. 
 tx or rx can be NULL if not important. */
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+/* Start a transfer and return without waiting for it to complete.
+Call sd_spi_transfer_wait_complete before touching the SPI again. */
+bool sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+bool sd_spi_transfer_wait_complete(sd_card_t *pSD, uint32_t timeout_ms);
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value);
 void sd_spi_deselect_pulse(sd_card_t *pSD);
 void sd_spi_acquire(sd_card_t *pSD);
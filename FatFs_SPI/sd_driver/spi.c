@@ -16,6 +16,7 @@ specific language governing permissions and limitations under the License.
 #include <stdbool.h>
 //
 #include "pico/stdlib.h"
+#include "pico/critical_section.h"
 #include "pico/mutex.h"
 #include "pico/sem.h"
 //
@@ -27,43 +28,12 @@ specific language governing permissions and limitations under the License.
 static bool irqChannel1 = false;
 static bool irqShared = true;
 
-static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
-    for (size_t i = 0; i < spi_get_num(); ++i) {
-        spi_t *spi_p = spi_get_by_num(i);
-        if (DMA_IRQ_num == spi_p->DMA_IRQ_num)  {
-            // Is the SPI's channel requesting interrupt?
-            if (*dma_hw_ints_p & (1 << spi_p->rx_dma)) {
-                *dma_hw_ints_p = 1 << spi_p->rx_dma;  // Clear it.
-                assert(!dma_channel_is_busy(spi_p->rx_dma));
-                assert(!sem_available(&spi_p->sem));
-                bool ok = sem_release(&spi_p->sem);
-                assert(ok);
-            }
-        }
-    }
-}
-static void __not_in_flash_func(spi_irq_handler_0)() {
-    in_spi_irq_handler(DMA_IRQ_0, &dma_hw->ints0);
-}
-static void __not_in_flash_func(spi_irq_handler_1)() {
-    in_spi_irq_handler(DMA_IRQ_1, &dma_hw->ints1);
-}
-
-void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
-    irqChannel1 = useChannel1;
-    irqShared = shared;
-}
-
-// SPI Transfer: Read & Write (simultaneously) on SPI bus
-//   If the data that will be received is not important, pass NULL as rx.
-//   If the data that will be transmitted is not important,
-//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
-//     element.
-bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
-    // assert(512 == length || 1 == length);
-    assert(tx || rx);
-    // assert(!(tx && rx));
+// There is only one DMA sniffer, shared by all SPIs
+auto_init_mutex(sniffer_mutex);
+static dma_channel_config *sniffed_cfg_p;
 
+static void spi_start_dma(spi_t *spi_p, const uint8_t *tx, uint8_t *rx,
+                          size_t length) {
     // tx write increment is already false
     if (tx) {
         channel_config_set_read_increment(&spi_p->tx_dma_cfg, true);
@@ -105,11 +75,75 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
         default:
             assert(false);
     }
-    sem_reset(&spi_p->sem, 0);
 
     // start them exactly simultaneously to avoid races (in extreme cases
     // the FIFO could overflow)
     dma_start_channel_mask((1u << spi_p->tx_dma) | (1u << spi_p->rx_dma));
+}
+
+// Called from the DMA IRQ handler when the asynchronous job at the head of
+// the queue has finished
+static void in_spi_xfer_complete(spi_t *spi_p) {
+    critical_section_enter_blocking(&spi_p->xfer_q_crit);
+    spi_xfer_job_t job = spi_p->xfer_q[spi_p->xfer_q_head];
+    spi_p->xfer_q_head = (spi_p->xfer_q_head + 1) % SPI_XFER_QUEUE_DEPTH;
+    // Keep the bus busy: start the next job before running the callback
+    if (--spi_p->xfer_q_count) {
+        spi_xfer_job_t *next_p = &spi_p->xfer_q[spi_p->xfer_q_head];
+        spi_start_dma(spi_p, next_p->tx, next_p->rx, next_p->length);
+    }
+    critical_section_exit(&spi_p->xfer_q_crit);
+    if (job.cb) job.cb(job.cb_arg);
+}
+
+static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
+    for (size_t i = 0; i < spi_get_num(); ++i) {
+        spi_t *spi_p = spi_get_by_num(i);
+        if (DMA_IRQ_num == spi_p->DMA_IRQ_num)  {
+            // Is the SPI's channel requesting interrupt?
+            if (*dma_hw_ints_p & (1 << spi_p->rx_dma)) {
+                *dma_hw_ints_p = 1 << spi_p->rx_dma;  // Clear it.
+                assert(!dma_channel_is_busy(spi_p->rx_dma));
+                if (spi_p->xfer_q_count) {
+                    // An asynchronous transfer finished
+                    in_spi_xfer_complete(spi_p);
+                } else {
+                    assert(!sem_available(&spi_p->sem));
+                    bool ok = sem_release(&spi_p->sem);
+                    assert(ok);
+                }
+            }
+        }
+    }
+}
+static void __not_in_flash_func(spi_irq_handler_0)() {
+    in_spi_irq_handler(DMA_IRQ_0, &dma_hw->ints0);
+}
+static void __not_in_flash_func(spi_irq_handler_1)() {
+    in_spi_irq_handler(DMA_IRQ_1, &dma_hw->ints1);
+}
+
+void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
+    irqChannel1 = useChannel1;
+    irqShared = shared;
+}
+
+// SPI Transfer: Read & Write (simultaneously) on SPI bus
+//   If the data that will be received is not important, pass NULL as rx.
+//   If the data that will be transmitted is not important,
+//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
+//     element.
+bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+    // assert(512 == length || 1 == length);
+    assert(tx || rx);
+    // assert(!(tx && rx));
+
+    // Let any queued asynchronous transfers finish first
+    if (!spi_transfer_wait_idle(spi_p, 1000)) return false;
+
+    sem_reset(&spi_p->sem, 0);
+
+    spi_start_dma(spi_p, tx, rx, length);
 
     /* Wait until master completes transfer or time out has occured. */
     uint32_t timeOut = 1000; /* Timeout 1 sec */
@@ -131,6 +165,93 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
     return true;
 }
 
+// Asynchronous SPI Transfer
+//   Queues a transfer and returns immediately. Transfers are started in the
+//   order they were queued; cb (if not NULL) is called from the DMA IRQ
+//   handler when the transfer is complete. The caller must hold the SPI
+//   (spi_lock, and the slave select asserted) until the transfer is done,
+//   and tx and rx must stay valid until then.
+//   Returns false if the queue is full.
+bool spi_transfer_async(spi_t *spi_p, const uint8_t *tx, uint8_t *rx,
+                        size_t length, spi_xfer_cb_t cb, void *cb_arg) {
+    assert(tx || rx);
+    critical_section_enter_blocking(&spi_p->xfer_q_crit);
+    if (SPI_XFER_QUEUE_DEPTH == spi_p->xfer_q_count) {
+        critical_section_exit(&spi_p->xfer_q_crit);
+        return false;
+    }
+    size_t ix = (spi_p->xfer_q_head + spi_p->xfer_q_count) % SPI_XFER_QUEUE_DEPTH;
+    spi_xfer_job_t *job_p = &spi_p->xfer_q[ix];
+    job_p->tx = tx;
+    job_p->rx = rx;
+    job_p->length = length;
+    job_p->cb = cb;
+    job_p->cb_arg = cb_arg;
+    // If the bus is idle, start right away. Otherwise, the IRQ handler will
+    // start it when its turn comes.
+    if (0 == spi_p->xfer_q_count++) spi_start_dma(spi_p, tx, rx, length);
+    critical_section_exit(&spi_p->xfer_q_crit);
+    return true;
+}
+
+// Wait for all queued asynchronous transfers to complete.
+//   On timeout, the transfers are aborted, the queue is emptied
+//   (without calling the callbacks), and false is returned.
+bool spi_transfer_wait_idle(spi_t *spi_p, uint32_t timeout_ms) {
+    if (!spi_p->xfer_q_count) return true;
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+    while (spi_p->xfer_q_count) {
+        if (0 >= absolute_time_diff_us(get_absolute_time(), timeout_time)) {
+            DBG_PRINTF("Asynchronous transfer timed out in %s\n", __FUNCTION__);
+            critical_section_enter_blocking(&spi_p->xfer_q_crit);
+            dma_channel_abort(spi_p->tx_dma);
+            dma_channel_abort(spi_p->rx_dma);
+            if (DMA_IRQ_0 == spi_p->DMA_IRQ_num)
+                dma_hw->ints0 = 1u << spi_p->rx_dma;
+            else
+                dma_hw->ints1 = 1u << spi_p->rx_dma;
+            spi_p->xfer_q_count = 0;
+            critical_section_exit(&spi_p->xfer_q_crit);
+            return false;
+        }
+        tight_loop_contents();
+    }
+    return true;
+}
+
+// Have the DMA sniffer compute the CRC16-CCITT (as used by SD cards: initial
+//   value 0) of the data of the following transfer(s) on this SPI, in hardware,
+//   as it goes by. If tx, the transmitted data are sniffed; otherwise, the
+//   received data. Returns false if the sniffer is in use elsewhere.
+//   On success, spi_crc16_sniff_finish must be called when the transfers are
+//   complete.
+bool spi_crc16_sniff_start(spi_t *spi_p, bool tx) {
+    if (!mutex_try_enter(&sniffer_mutex, NULL)) return false;
+    uint channel;
+    if (tx) {
+        channel = spi_p->tx_dma;
+        sniffed_cfg_p = &spi_p->tx_dma_cfg;
+    } else {
+        channel = spi_p->rx_dma;
+        sniffed_cfg_p = &spi_p->rx_dma_cfg;
+    }
+    channel_config_set_sniff_enable(sniffed_cfg_p, true);
+    dma_sniffer_enable(channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, false);
+    dma_sniffer_set_data_accumulator(0);
+    return true;
+}
+
+// Returns the CRC computed by the DMA sniffer and releases it
+uint16_t spi_crc16_sniff_finish(spi_t *spi_p) {
+    (void)spi_p;
+    uint16_t crc = dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    channel_config_set_sniff_enable(sniffed_cfg_p, false);
+    sniffed_cfg_p = NULL;
+    mutex_exit(&sniffer_mutex);
+    return crc;
+}
+
 void spi_lock(spi_t *spi_p) {
     assert(mutex_is_initialized(&spi_p->mutex));
     mutex_enter_blocking(&spi_p->mutex);
@@ -155,6 +276,11 @@ bool my_spi_init(spi_t *spi_p) {
             spi_p->baud_rate = 10 * 1000 * 1000;
         // For the IRQ notification:
         sem_init(&spi_p->sem, 0, 1);
+        // For the asynchronous transfer queue:
+        if (!critical_section_is_initialized(&spi_p->xfer_q_crit))
+            critical_section_init(&spi_p->xfer_q_crit);
+        spi_p->xfer_q_head = 0;
+        spi_p->xfer_q_count = 0;
 
         /* Configure component */
         // Enable SPI at 100 kHz and connect to GPIOs
@@ -21,12 +21,31 @@ specific language governing permissions and limitations under the License.
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
 #include "hardware/spi.h"
+#include "pico/critical_section.h"
 #include "pico/mutex.h"
 #include "pico/sem.h"
 #include "pico/types.h"
 
 #define SPI_FILL_CHAR (0xFF)
 
+// Maximum number of asynchronous transfers that can be queued on one SPI
+#ifndef SPI_XFER_QUEUE_DEPTH
+#define SPI_XFER_QUEUE_DEPTH 4
+#endif
+
+// Completion callback for spi_transfer_async.
+// Note: this is called from the DMA interrupt handler.
+typedef void (*spi_xfer_cb_t)(void *cb_arg);
+
+// A queued asynchronous transfer
+typedef struct {
+    const uint8_t *tx;
+    uint8_t *rx;
+    size_t length;
+    spi_xfer_cb_t cb;  // May be NULL
+    void *cb_arg;
+} spi_xfer_job_t;
+
 // "Class" representing SPIs
 typedef struct {
     // SPI HW
@@ -53,6 +72,11 @@ typedef struct {
     bool initialized;  
     semaphore_t sem;
     mutex_t mutex;    
+    // Asynchronous transfer queue:
+    critical_section_t xfer_q_crit;
+    spi_xfer_job_t xfer_q[SPI_XFER_QUEUE_DEPTH];
+    volatile size_t xfer_q_head;   // Index of the job on the wire
+    volatile size_t xfer_q_count;  // Number of jobs queued, including the one on the wire
 } spi_t;
 
 #ifdef __cplusplus
@@ -60,6 +84,11 @@ extern "C" {
 #endif
   
 bool __not_in_flash_func(spi_transfer)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);  
+bool __not_in_flash_func(spi_transfer_async)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length,
+                                             spi_xfer_cb_t cb, void *cb_arg);
+bool spi_transfer_wait_idle(spi_t *pSPI, uint32_t timeout_ms);
+bool spi_crc16_sniff_start(spi_t *pSPI, bool tx);
+uint16_t spi_crc16_sniff_finish(spi_t *pSPI);
 void spi_lock(spi_t *pSPI);
 void spi_unlock(spi_t *pSPI);
 bool my_spi_init(spi_t *pSPI);
@@ -0,0 +1,223 @@
+/* bin_log.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// See bin_log.h and bin_log_format.h
+
+#include <string.h>
+#include <time.h>
+//
+#include "pico/stdlib.h"
+//
+#include "bin_log.h"
+#include "crc.h"
+#include "my_debug.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+static uint16_t get16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static void start_block(bin_log_t *log) {
+    memset(log->block, 0, sizeof log->block);
+    put32(log->block + BIN_LOG_HDR_MAGIC, BIN_LOG_MAGIC);
+    put32(log->block + BIN_LOG_HDR_FILE_ID, log->file_id);
+    put32(log->block + BIN_LOG_HDR_SEQ, log->seq);
+    log->used = BIN_LOG_HDR_SIZE;
+}
+
+static FRESULT write_block(bin_log_t *log) {
+    put16(log->block + BIN_LOG_HDR_USED, log->used);
+    put16(log->block + BIN_LOG_HDR_CRC,
+          crc16((const char *)log->block, BIN_LOG_HDR_CRC));
+    FSIZE_t pos = (FSIZE_t)log->seq * BIN_LOG_BLOCK_SIZE;
+    FRESULT fr = FR_OK;
+    if (f_tell(&log->file) != pos) fr = f_lseek(&log->file, pos);
+    if (FR_OK != fr) return fr;
+    UINT bw;
+    fr = f_write(&log->file, log->block, sizeof log->block, &bw);
+    if (FR_OK != fr) return fr;
+    if (bw < sizeof log->block) return FR_DENIED;  // Volume full
+    ++log->stats.blocks_written;
+    log->dirty = false;
+    return FR_OK;
+}
+
+FRESULT bin_log_append(bin_log_t *log, uint8_t type, const void *payload,
+                       size_t len) {
+    if (len > BIN_LOG_MAX_PAYLOAD) return FR_INVALID_PARAMETER;
+    size_t size = len + BIN_LOG_REC_OVERHEAD;
+    if (log->used + size > BIN_LOG_BLOCK_SIZE) {
+        if (log->dirty) {
+            FRESULT fr = write_block(log);
+            if (FR_OK != fr) return fr;
+        }
+        ++log->seq;
+        start_block(log);
+    }
+    uint8_t *p = log->block + log->used;
+    p[0] = len;
+    p[1] = type;
+    memcpy(p + 2, payload, len);
+    put16(p + 2 + len, crc16((const char *)p, len + 2));
+    log->used += size;
+    log->dirty = true;
+    ++log->stats.records;
+    return FR_OK;
+}
+
+FRESULT bin_log_define(bin_log_t *log, uint8_t type, const char *format,
+                       const char *columns) {
+    uint8_t payload[BIN_LOG_MAX_PAYLOAD];
+    size_t flen = strlen(format) + 1, clen = strlen(columns);
+    if (1 + flen + clen > sizeof payload) return FR_INVALID_PARAMETER;
+    payload[0] = type;
+    memcpy(payload + 1, format, flen);
+    memcpy(payload + 1 + flen, columns, clen);
+    return bin_log_append(log, BIN_LOG_TYPE_SCHEMA, payload, 1 + flen + clen);
+}
+
+FRESULT bin_log_sync(bin_log_t *log) {
+    if (log->dirty) {
+        FRESULT fr = write_block(log);
+        if (FR_OK != fr) return fr;
+    }
+    ++log->stats.syncs;
+    return f_sync(&log->file);
+}
+
+FRESULT bin_log_close(bin_log_t *log) {
+    FRESULT fr = FR_OK;
+    if (log->dirty) fr = write_block(log);
+    // Give back any preallocated space that wasn't used
+    if (FR_OK == fr)
+        fr = f_lseek(&log->file, (FSIZE_t)(log->seq + 1) * BIN_LOG_BLOCK_SIZE);
+    if (FR_OK == fr) fr = f_truncate(&log->file);
+    FRESULT fr2 = f_close(&log->file);
+    return FR_OK == fr ? fr2 : fr;
+}
+
+// Read block n and check its header
+static FRESULT read_block(FIL *fp, uint32_t n, uint8_t *block, bool *valid,
+                          bin_log_end_t *end) {
+    FRESULT fr = f_lseek(fp, (FSIZE_t)n * BIN_LOG_BLOCK_SIZE);
+    if (FR_OK != fr) return fr;
+    UINT br;
+    fr = f_read(fp, block, BIN_LOG_BLOCK_SIZE, &br);
+    if (FR_OK != fr) return fr;
+    ++end->reads;
+    uint16_t used = get16(block + BIN_LOG_HDR_USED);
+    *valid = br == BIN_LOG_BLOCK_SIZE &&
+             get32(block + BIN_LOG_HDR_MAGIC) == BIN_LOG_MAGIC &&
+             get16(block + BIN_LOG_HDR_CRC) ==
+                 crc16((const char *)block, BIN_LOG_HDR_CRC) &&
+             get32(block + BIN_LOG_HDR_SEQ) == n &&
+             (0 == n || get32(block + BIN_LOG_HDR_FILE_ID) == end->file_id) &&
+             BIN_LOG_HDR_SIZE <= used && used <= BIN_LOG_BLOCK_SIZE;
+    return FR_OK;
+}
+
+FRESULT bin_log_recover(FIL *fp, uint8_t block[BIN_LOG_BLOCK_SIZE],
+                        bin_log_end_t *end) {
+    TRACE_PRINTF("%s\n", __func__);
+    memset(end, 0, sizeof *end);
+    bool valid;
+    FRESULT fr = read_block(fp, 0, block, &valid, end);
+    if (FR_OK != fr) return fr;
+    if (!valid) return FR_NO_FILE;
+    end->file_id = get32(block + BIN_LOG_HDR_FILE_ID);
+
+    // Blocks lo and before are valid; hi and after are not
+    uint32_t lo = 0, hi = f_size(fp) / BIN_LOG_BLOCK_SIZE, last = 0;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        fr = read_block(fp, mid, block, &valid, end);
+        if (FR_OK != fr) return fr;
+        last = mid;
+        if (valid)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    if (last != lo) {
+        fr = read_block(fp, lo, block, &valid, end);
+        if (FR_OK != fr) return fr;
+    }
+    end->blocks = lo + 1;
+
+    // The last block could have been torn while being rewritten
+    uint16_t used = get16(block + BIN_LOG_HDR_USED);
+    uint16_t pos = BIN_LOG_HDR_SIZE;
+    while (pos + BIN_LOG_REC_OVERHEAD <= used) {
+        const uint8_t *p = block + pos;
+        size_t len = p[0];
+        if (pos + len + BIN_LOG_REC_OVERHEAD > used) break;
+        if (get16(p + 2 + len) != crc16((const char *)p, len + 2)) break;
+        pos += len + BIN_LOG_REC_OVERHEAD;
+        ++end->records;
+    }
+    end->used = pos;
+    return FR_OK;
+}
+
+FRESULT bin_log_open(bin_log_t *log, const TCHAR *path, FSIZE_t prealloc) {
+    TRACE_PRINTF("%s(%s)\n", __func__, path);
+    memset(&log->stats, 0, sizeof log->stats);
+    FRESULT fr = f_open(&log->file, path, FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    if (f_size(&log->file)) {
+        bin_log_end_t end;
+        fr = bin_log_recover(&log->file, log->block, &end);
+        if (FR_OK != fr) {
+            f_close(&log->file);
+            return fr;
+        }
+        // Carry on filling the last block
+        log->file_id = end.file_id;
+        log->seq = end.blocks - 1;
+        log->used = end.used;
+        memset(log->block + end.used, 0, sizeof log->block - end.used);
+        log->dirty = false;
+        return FR_OK;
+    }
+    // Distinguish this file's blocks from old data in preallocated space
+    log->file_id = time_us_32() ^ (uint32_t)time(NULL) * 2654435761u;
+    if (prealloc) {
+        fr = f_expand(&log->file, prealloc, 1);
+        if (FR_DENIED == fr) {
+            DBG_PRINTF("%s: no contiguous space for %s\n", __func__, path);
+        } else if (FR_OK != fr) {
+            f_close(&log->file);
+            return fr;
+        }
+    }
+    // Block 0 identifies the log, even before there are records in it
+    log->seq = 0;
+    start_block(log);
+    fr = write_block(log);
+    if (FR_OK == fr) fr = f_sync(&log->file);
+    if (FR_OK != fr) f_close(&log->file);
+    return fr;
+}
+
+/* [] END OF FILE */
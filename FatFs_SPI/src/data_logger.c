@@ -0,0 +1,244 @@
+/* data_logger.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// See data_logger.h
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+//
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+//
+#include "data_logger.h"
+#include "f_util.h"
+#include "my_debug.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+bool data_logger_init(data_logger_t *lg) {
+    TRACE_PRINTF("%s\n", __func__);
+    myASSERT(lg && lg->dir && lg->suffix && lg->buf);
+    // The ring is indexed by masking free running counts
+    myASSERT(lg->buf_size >= 1024 && !(lg->buf_size & (lg->buf_size - 1)));
+    if (!lg->batch_size) lg->batch_size = lg->buf_size / 4;
+    myASSERT(FF_MAX_SS <= lg->batch_size && lg->batch_size <= lg->buf_size);
+    if (!critical_section_is_initialized(&lg->crit))
+        critical_section_init(&lg->crit);
+    lg->head = 0;
+    lg->tail = 0;
+    lg->file_open = false;
+    lg->unsynced = false;
+    lg->error = FR_OK;
+    memset(&lg->stats, 0, sizeof lg->stats);
+    return true;
+}
+
+bool data_logger_write(data_logger_t *lg, const void *record, size_t len) {
+    critical_section_enter_blocking(&lg->crit);
+    uint32_t head = lg->head;
+    uint32_t used = head - lg->tail;
+    if (len > lg->buf_size - used) {
+        ++lg->stats.dropped;
+        critical_section_exit(&lg->crit);
+        return false;
+    }
+    __mem_fence_acquire();  // Tail before overwriting the space it freed
+    size_t off = head & (lg->buf_size - 1);
+    size_t first = MIN(len, lg->buf_size - off);
+    memcpy(lg->buf + off, record, first);
+    memcpy(lg->buf, (const uint8_t *)record + first, len - first);
+    __mem_fence_release();  // Record before head
+    lg->head = head + len;
+    ++lg->stats.records;
+    used += len;
+    if (used > lg->stats.max_used) lg->stats.max_used = used;
+    critical_section_exit(&lg->crit);
+    return true;
+}
+
+bool data_logger_printf(data_logger_t *lg, const char *fmt, ...) {
+    char buf[DATA_LOGGER_MAX_RECORD];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    myASSERT(0 <= n && n < (int)sizeof buf);
+    if (n < 0) return false;
+    if (n >= (int)sizeof buf) n = sizeof buf - 1;  // Truncated
+    return data_logger_write(lg, buf, n);
+}
+
+static void close_file(data_logger_t *lg) {
+    lg->file_open = false;
+    lg->unsynced = false;
+    FRESULT fr = f_close(&lg->file);
+    if (FR_OK != fr) printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
+}
+
+// f_write returns FR_OK with a short count when the volume is full
+static FRESULT write_all(data_logger_t *lg, const void *buff, UINT btw,
+                         UINT *bw) {
+    FRESULT fr = f_write(&lg->file, buff, btw, bw);
+    ++lg->stats.writes;
+    if (*bw) lg->unsynced = true;
+    if (FR_OK == fr && *bw < btw) fr = FR_DENIED;
+    if (FR_OK != fr) {
+        printf("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+        close_file(lg);
+        // Retrying won't make room
+        if (FR_DENIED == fr) lg->error = fr;
+    }
+    return fr;
+}
+
+// Write count bytes from the ring to the file
+static bool write_out(data_logger_t *lg, size_t count) {
+    uint32_t tail = lg->tail;
+    size_t off = tail & (lg->buf_size - 1);
+    size_t first = MIN(count, lg->buf_size - off);
+    size_t parts[2] = {first, count - first};
+    const uint8_t *from[2] = {lg->buf + off, lg->buf};
+    for (size_t i = 0; i < count_of(parts); ++i) {
+        if (!parts[i]) continue;
+        UINT bw = 0;
+        FRESULT fr = write_all(lg, from[i], parts[i], &bw);
+        // Whatever made it to the file is done with, so that it isn't
+        // written again. The rest goes to a new file on the next call.
+        lg->stats.bytes_written += bw;
+        __mem_fence_release();  // Done with the data before tail
+        tail += bw;
+        lg->tail = tail;
+        if (FR_OK != fr) return false;
+    }
+    return true;
+}
+
+// Write what is waiting: all of it, or only whole sectors' worth once
+// batch_size bytes have accumulated, so that f_write goes straight
+// to the card instead of through the file's sector buffer.
+static bool drain(data_logger_t *lg, bool all) {
+    size_t avail = lg->head - lg->tail;
+    __mem_fence_acquire();  // Head before the data
+    if (!avail) return true;
+    if (!all) {
+        if (avail < lg->batch_size) return true;
+        FSIZE_t pos = f_tell(&lg->file);
+        avail = ((pos + avail) & ~(FSIZE_t)(FF_MAX_SS - 1)) - pos;
+    }
+    return write_out(lg, avail);
+}
+
+static bool sync_file(data_logger_t *lg) {
+    if (!lg->unsynced) return true;
+    FRESULT fr = f_sync(&lg->file);
+    ++lg->stats.syncs;
+    if (FR_OK != fr) {
+        printf("f_sync error: %s (%d)\n", FRESULT_str(fr), fr);
+        close_file(lg);
+        return false;
+    }
+    lg->unsynced = false;
+    return true;
+}
+
+static bool open_file(data_logger_t *lg, const struct tm *ptm) {
+    TRACE_PRINTF("%s\n", __func__);
+    char filename[FF_LFN_BUF + 1];
+    int n = snprintf(filename, sizeof filename, "%s", lg->dir);
+    myASSERT(0 < n && n < (int)sizeof filename);
+    FRESULT fr = f_mkdir(filename);
+    if (FR_OK != fr && FR_EXIST != fr) {
+        printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+    n += snprintf(filename + n, sizeof filename - n, "/%04d-%02d-%02d",
+                  ptm->tm_year + 1900, ptm->tm_mon + 1, ptm->tm_mday);
+    myASSERT(0 < n && n < (int)sizeof filename);
+    fr = f_mkdir(filename);
+    if (FR_OK != fr && FR_EXIST != fr) {
+        printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+    n += snprintf(filename + n, sizeof filename - n, "/%02d%s", ptm->tm_hour,
+                  lg->suffix);
+    myASSERT(0 < n && n < (int)sizeof filename);
+    fr = f_open(&lg->file, filename, FA_OPEN_APPEND | FA_WRITE);
+    if (FR_OK != fr) {
+        printf("f_open(%s) error: %s (%d)\n", filename, FRESULT_str(fr), fr);
+        return false;
+    }
+    lg->file_open = true;
+    lg->file_hour = ptm->tm_hour;
+    lg->file_mday = ptm->tm_mday;
+    ++lg->stats.files;
+    if (lg->header && 0 == f_size(&lg->file)) {
+        UINT bw = 0;
+        if (FR_OK != write_all(lg, lg->header, strlen(lg->header), &bw))
+            return false;
+    }
+    if (lg->sync_period_ms)
+        lg->next_sync = make_timeout_time_ms(lg->sync_period_ms);
+    return true;
+}
+
+bool data_logger_task(data_logger_t *lg) {
+    if (FR_OK != lg->error) return false;
+    const time_t secs = time(NULL);
+    struct tm tmbuf;
+    struct tm *ptm = localtime_r(&secs, &tmbuf);
+    if (lg->file_open &&
+        (ptm->tm_hour != lg->file_hour || ptm->tm_mday != lg->file_mday)) {
+        // Time for a new file. What is waiting belongs to the old one.
+        bool ok = drain(lg, true);
+        if (lg->file_open) close_file(lg);
+        if (!ok) return false;
+    }
+    if (!lg->file_open) {
+        if (lg->head == lg->tail) return true;  // Nothing to do yet
+        if (!open_file(lg, ptm)) return false;
+    }
+    if (!drain(lg, false)) return false;
+    if (lg->sync_period_ms && time_reached(lg->next_sync)) {
+        lg->next_sync = make_timeout_time_ms(lg->sync_period_ms);
+        if (!drain(lg, true)) return false;
+        if (!sync_file(lg)) return false;
+    }
+    return true;
+}
+
+bool data_logger_close(data_logger_t *lg) {
+    TRACE_PRINTF("%s\n", __func__);
+    if (FR_OK != lg->error) return false;
+    bool ok = true;
+    if (!lg->file_open && lg->head != lg->tail) {
+        const time_t secs = time(NULL);
+        struct tm tmbuf;
+        ok = open_file(lg, localtime_r(&secs, &tmbuf));
+    }
+    if (lg->file_open) {
+        ok = drain(lg, true) && ok;
+        if (lg->file_open) close_file(lg);
+    }
+    return ok;
+}
+
+void data_logger_get_stats(data_logger_t *lg, data_logger_stats_t *stats) {
+    critical_section_enter_blocking(&lg->crit);
+    *stats = lg->stats;
+    critical_section_exit(&lg->crit);
+}
+
+/* [] END OF FILE */
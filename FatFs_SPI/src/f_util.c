@@ -11,7 +11,14 @@ under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
 CONDITIONS OF ANY KIND, either express or implied. See the License for the 
 specific language governing permissions and limitations under the License.
 */
+#include <stdbool.h>
+//
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/mutex.h"
+//
 #include "ff.h"
+#include "f_util.h"
 
 const char *FRESULT_str(FRESULT i) {
     switch (i) {
@@ -103,3 +110,69 @@ FRESULT delete_node (
     if (fr == FR_OK) fr = f_unlink(path);  /* Delete the empty sub-directory */
     return fr;
 }
+
+static const char *volatile core1_owner_name;
+auto_init_mutex(core1_mutex);
+
+bool core1_claim(const char *owner) {
+    mutex_enter_blocking(&core1_mutex);
+    bool ok = !core1_owner_name;
+    if (ok) core1_owner_name = owner;
+    mutex_exit(&core1_mutex);
+    return ok;
+}
+
+void core1_release() {
+    mutex_enter_blocking(&core1_mutex);
+    core1_owner_name = NULL;
+    mutex_exit(&core1_mutex);
+}
+
+const char *core1_owner() { return core1_owner_name; }
+
+static struct {
+    TCHAR path[FF_LFN_BUF + 1];
+    getfree_progress_t progress;
+    volatile bool busy;
+    bool claimed;  // Core 1, until the result is collected
+    FRESULT fr;
+    DWORD nclst;
+} getfree_bg;
+
+// Called by f_getfree as it scans the FAT
+void ff_getfree_progress(FATFS *fs, DWORD done, DWORD total) {
+    (void)fs;
+    if (getfree_bg.busy && getfree_bg.progress) getfree_bg.progress(done, total);
+}
+
+static void getfree_core1() {
+    FATFS *fs;
+    getfree_bg.fr = f_getfree(getfree_bg.path, &getfree_bg.nclst, &fs);
+    __mem_fence_release();
+    getfree_bg.busy = false;
+}
+
+bool f_getfree_start(const TCHAR *path, getfree_progress_t progress) {
+    if (getfree_bg.busy || !core1_claim("f_getfree_start")) return false;
+    size_t i;
+    for (i = 0; path[i] && i < FF_LFN_BUF; ++i) getfree_bg.path[i] = path[i];
+    getfree_bg.path[i] = 0;
+    getfree_bg.progress = progress;
+    getfree_bg.busy = true;
+    getfree_bg.claimed = true;
+    multicore_reset_core1();
+    multicore_launch_core1(getfree_core1);
+    return true;
+}
+
+bool f_getfree_done(FRESULT *fr, DWORD *nclst) {
+    if (getfree_bg.busy) return false;
+    __mem_fence_acquire();
+    if (getfree_bg.claimed) {
+        getfree_bg.claimed = false;
+        core1_release();
+    }
+    *fr = getfree_bg.fr;
+    *nclst = getfree_bg.nclst;
+    return true;
+}
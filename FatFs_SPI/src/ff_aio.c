@@ -0,0 +1,83 @@
+/* ff_aio.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// See ff_aio.h
+
+#include <errno.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "ff_aio.h"
+
+static int submit(ff_aiocb_t *pxCb) {
+    if (!io_engine_running()) io_engine_start();
+    if (!io_engine_submit(pxCb)) {
+        pxCb->done = true;
+        pxCb->error = io_engine_running() ? EAGAIN : ENOSYS;
+        errno = pxCb->error;
+        return -1;
+    }
+    return 0;
+}
+
+static int transfer(io_op_t op, FIL *pxStream, void *pvBuffer, size_t xSize,
+                    ff_aiocb_t *pxCb) {
+    memset(pxCb, 0, sizeof *pxCb);
+    pxCb->op = op;
+    pxCb->file = pxStream;
+    pxCb->buf = pvBuffer;
+    pxCb->len = xSize;
+    return submit(pxCb);
+}
+
+int ff_aio_read(FIL *pxStream, void *pvBuffer, size_t xSize, ff_aiocb_t *pxCb) {
+    return transfer(IO_READ, pxStream, pvBuffer, xSize, pxCb);
+}
+
+int ff_aio_write(FIL *pxStream, const void *pvBuffer, size_t xSize, ff_aiocb_t *pxCb) {
+    return transfer(IO_WRITE, pxStream, (void *)pvBuffer, xSize, pxCb);
+}
+
+int ff_aio_fsync(FIL *pxStream, ff_aiocb_t *pxCb) {
+    return transfer(IO_SYNC, pxStream, NULL, 0, pxCb);
+}
+
+int ff_aio_error(ff_aiocb_t *pxCb) {
+    if (!pxCb->done) io_engine_poll();
+    return pxCb->done ? pxCb->error : EINPROGRESS;
+}
+
+ssize_t ff_aio_return(ff_aiocb_t *pxCb) {
+    if (!pxCb->done) {
+        errno = EINVAL;
+        return -1;
+    }
+    return pxCb->result;
+}
+
+int ff_aio_suspend(ff_aiocb_t *const list[], int nent, uint64_t timeout_us) {
+    uint64_t start = time_us_64();
+    for (;;) {
+        io_engine_poll();
+        for (int i = 0; i < nent; ++i)
+            if (list[i] && list[i]->done) return 0;
+        if (timeout_us && time_us_64() - start >= timeout_us) {
+            errno = EAGAIN;
+            return -1;
+        }
+        tight_loop_contents();
+    }
+}
+
+/* [] END OF FILE */
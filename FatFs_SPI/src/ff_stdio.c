@@ -23,10 +23,225 @@ specific language governing permissions and limitations under the License.
 //
 #include "f_util.h"
 #include "ff_stdio.h"
+#include "obj_pool.h"
 
 #define TRACE_PRINTF(fmt, args...) {}
 //#define TRACE_PRINTF printf
 
+// Number of extents (runs of contiguous clusters) of a file that a stream
+// remembers, so that seeking back doesn't follow the cluster chain from the
+// start of the file. 8 bytes each.
+#ifndef FF_STDIO_EXTENTS
+#define FF_STDIO_EXTENTS 32
+#endif
+
+// Number of streams kept in a pool in static memory, so that opening and
+// closing files doesn't fragment the heap. When they are all in use,
+// streams come from the heap.
+#ifndef FF_STDIO_STREAMS
+#define FF_STDIO_STREAMS 4
+#endif
+
+// Number of sets of working space for ff_findfirst's two path names kept in
+// a pool (one per core), rather than on the stack. Spares come from the heap.
+#ifndef FF_STDIO_FIND_BUFS
+#define FF_STDIO_FIND_BUFS 2
+#endif
+
+// Size of the buffer ff_fopen gives each stream (see ff_setvbuf), allocated
+// from the heap. 0: streams start unbuffered.
+#ifndef FF_STDIO_BUFSIZ
+#define FF_STDIO_BUFSIZ 0
+#endif
+
+typedef struct {
+    FIL fil;  // Must be first: a FF_FILE * points to the stream
+#if FF_USE_EXTCACHE
+    FXCACHE xcache;
+    FEXT extents[FF_STDIO_EXTENTS];
+#endif
+    // User space buffer. While writing, it holds len bytes that belong at
+    // the file pointer. While reading, the bytes from pos to len are the
+    // ones just before the file pointer.
+    uint8_t *buf;
+    size_t size, pos, len;
+    int mode;  // FF_IOFBF, FF_IOLBF or FF_IONBF
+    bool writing;
+    bool own_buf;  // buf was allocated by ff_setvbuf
+} stream_t;
+
+#define STREAM(pxStream) ((stream_t *)(pxStream))
+
+typedef struct {
+    char cwd[ffconfigMAX_FILENAME];
+    char dir[ffconfigMAX_FILENAME];
+} find_bufs_t;
+
+#if FF_STDIO_STREAMS
+static stream_t streams[FF_STDIO_STREAMS];
+auto_init_mutex(stream_pool_mutex);
+static obj_pool_t stream_pool = OBJ_POOL_INIT(
+    streams, sizeof(stream_t), FF_STDIO_STREAMS, &stream_pool_mutex);
+#endif
+#if FF_STDIO_FIND_BUFS
+static find_bufs_t find_bufs[FF_STDIO_FIND_BUFS];
+auto_init_mutex(find_pool_mutex);
+static obj_pool_t find_pool = OBJ_POOL_INIT(
+    find_bufs, sizeof(find_bufs_t), FF_STDIO_FIND_BUFS, &find_pool_mutex);
+#endif
+
+// Take an object from pool, or from the heap if the pool is empty.
+// With PICO_MALLOC_PANIC (the SDK's default), malloc panics instead of
+// returning NULL, so the FR_NOT_ENOUGH_CORE and ENOMEM returns for a
+// failed allocation are only reached when PICO_MALLOC_PANIC is 0.
+static void *pool_alloc(obj_pool_t *pool, size_t size) {
+    void *obj = pool ? obj_pool_alloc(pool) : NULL;
+    return obj ? obj : malloc(size);
+}
+static void pool_free(obj_pool_t *pool, void *obj) {
+    if (pool && obj_pool_owns(pool, obj))
+        obj_pool_free(pool, obj);
+    else
+        free(obj);
+}
+#if FF_STDIO_STREAMS
+#define STREAM_POOL (&stream_pool)
+#else
+#define STREAM_POOL NULL
+#endif
+#if FF_STDIO_FIND_BUFS
+#define FIND_POOL (&find_pool)
+#else
+#define FIND_POOL NULL
+#endif
+
+static FIL *stream_open(const char *pcFile, BYTE mode, FRESULT *fr) {
+    stream_t *s = pool_alloc(STREAM_POOL, sizeof(stream_t));
+    if (!s) {
+        *fr = FR_NOT_ENOUGH_CORE;
+        return NULL;
+    }
+    *fr = f_open(&s->fil, pcFile, mode);
+    if (FR_OK != *fr) {
+        pool_free(STREAM_POOL, s);
+        return NULL;
+    }
+    s->buf = NULL;
+    s->size = s->pos = s->len = 0;
+    s->mode = FF_IONBF;
+    s->writing = false;
+    s->own_buf = false;
+#if FF_STDIO_BUFSIZ
+    // Carry on unbuffered if there is no room for a buffer
+    ff_setvbuf(&s->fil, NULL, FF_IOFBF, FF_STDIO_BUFSIZ);
+#endif
+#if FF_USE_EXTCACHE
+    s->xcache.ext = s->extents;
+    s->xcache.size = FF_STDIO_EXTENTS;
+    s->xcache.n = 0;
+    s->xcache.ncl = 0;
+    s->fil.xcache = &s->xcache;
+#endif
+    return &s->fil;
+}
+
+static FRESULT write_out(stream_t *s) {
+    UINT bw = 0;
+    FRESULT fr = f_write(&s->fil, s->buf, s->len, &bw);
+    if (FR_OK == fr && bw < s->len) fr = FR_DENIED;  // Volume full
+    s->len = 0;
+    return fr;
+}
+
+// Hand the stream back to FatFs: write out buffered output, or give up
+// read-ahead by moving the file pointer back to where the caller is
+static FRESULT drain(stream_t *s) {
+    FRESULT fr = FR_OK;
+    if (s->writing) {
+        if (s->len) fr = write_out(s);
+        s->writing = false;
+    } else if (s->pos < s->len) {
+        fr = f_lseek(&s->fil, f_tell(&s->fil) - (s->len - s->pos));
+    }
+    s->pos = s->len = 0;
+    return fr;
+}
+
+// The position as the caller sees it
+static FSIZE_t stream_tell(stream_t *s) {
+    if (s->writing) return f_tell(&s->fil) + s->len;
+    return f_tell(&s->fil) - (s->len - s->pos);
+}
+
+static FRESULT stream_write(stream_t *s, const uint8_t *data, size_t n,
+                            size_t *done) {
+    FRESULT fr = FR_OK;
+    *done = 0;
+    if (FF_IONBF == s->mode) {
+        UINT bw = 0;
+        fr = f_write(&s->fil, data, n, &bw);
+        *done = bw;
+        return fr;
+    }
+    if (!s->writing) {
+        fr = drain(s);
+        if (FR_OK != fr) return fr;
+        s->writing = true;
+    }
+    if (s->len + n > s->size && s->len) {
+        fr = write_out(s);
+        if (FR_OK != fr) return fr;
+    }
+    if (n >= s->size) {  // No point in copying it
+        UINT bw = 0;
+        fr = f_write(&s->fil, data, n, &bw);
+        *done = bw;
+        return fr;
+    }
+    memcpy(s->buf + s->len, data, n);
+    s->len += n;
+    *done = n;
+    if (FF_IOLBF == s->mode && memchr(data, '\n', n)) fr = write_out(s);
+    return fr;
+}
+
+static FRESULT stream_read(stream_t *s, uint8_t *data, size_t n,
+                           size_t *done) {
+    FRESULT fr = FR_OK;
+    *done = 0;
+    if (FF_IONBF == s->mode) {
+        UINT br = 0;
+        fr = f_read(&s->fil, data, n, &br);
+        *done = br;
+        return fr;
+    }
+    if (s->writing) {
+        fr = drain(s);
+        if (FR_OK != fr) return fr;
+    }
+    while (*done < n) {
+        if (s->pos < s->len) {
+            size_t k = n - *done;
+            if (k > s->len - s->pos) k = s->len - s->pos;
+            memcpy(data + *done, s->buf + s->pos, k);
+            s->pos += k;
+            *done += k;
+        } else if (n - *done >= s->size) {  // Straight into the caller's buffer
+            UINT br = 0;
+            fr = f_read(&s->fil, data + *done, n - *done, &br);
+            *done += br;
+            break;
+        } else {
+            UINT br = 0;
+            fr = f_read(&s->fil, s->buf, s->size, &br);
+            s->pos = 0;
+            s->len = br;
+            if (FR_OK != fr || !br) break;
+        }
+    }
+    return fr;
+}
+
 static BYTE posix2mode(const char *pcMode) {
     if (0 == strcmp("r", pcMode)) return FA_READ;
     if (0 == strcmp("r+", pcMode)) return FA_READ | FA_WRITE;
@@ -94,35 +309,39 @@ FF_FILE *ff_fopen(const char *pcFile, const char *pcMode) {
     //  const TCHAR* path, /* [IN] File name */
     //  BYTE mode          /* [IN] Mode flags */
     //);
-    FIL *fp = malloc(sizeof(FIL));
-    if (!fp) {
-        errno = ENOMEM;
-        return NULL;
-    }
-    FRESULT fr = f_open(fp, pcFile, posix2mode(pcMode));
+    FRESULT fr;
+    FIL *fp = ff_fopen_fr(pcFile, pcMode, &fr);
     errno = fresult2errno(fr);
-    if (FR_OK != fr) {
+    if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
-        free(fp);
-        fp = 0;
-    }
     return fp;
 }
+FF_FILE *ff_fopen_fr(const char *pcFile, const char *pcMode, FRESULT *fr) {
+    return stream_open(pcFile, posix2mode(pcMode), fr);
+}
 int ff_fclose(FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
-    // FRESULT f_close (
-    //  FIL* fp     /* [IN] Pointer to the file object */
-    //);
-    FRESULT fr = f_close(pxStream);
+    FRESULT fr = ff_fclose_fr(pxStream);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
-    free(pxStream);
     if (FR_OK == fr)
         return 0;
     else
         return -1;
 }
+FRESULT ff_fclose_fr(FF_FILE *pxStream) {
+    // FRESULT f_close (
+    //  FIL* fp     /* [IN] Pointer to the file object */
+    //);
+    stream_t *s = STREAM(pxStream);
+    FRESULT fr = drain(s);
+    FRESULT fr2 = f_close(pxStream);
+    if (FR_OK == fr) fr = fr2;
+    if (s->own_buf) free(s->buf);
+    pool_free(STREAM_POOL, s);
+    return fr;
+}
 // Populates an ff_stat_struct with information about a file.
 int ff_stat(const char *pcFileName, FF_Stat_t *pxStatBuffer) {
     TRACE_PRINTF("%s\n", __func__);
@@ -152,13 +371,18 @@ size_t ff_fwrite(const void *pvBuffer, size_t xSize, size_t xItems,
     //  UINT* bw          /* [OUT] Pointer to the variable to return number of
     //  bytes written */
     //);
-    UINT bw = 0;
-    FRESULT fr = f_write(pxStream, pvBuffer, xSize * xItems, &bw);
+    size_t bw = 0;
+    FRESULT fr = ff_fwrite_fr(pvBuffer, xSize * xItems, pxStream, &bw);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
     return bw / xSize;
 }
+FRESULT ff_fwrite_fr(const void *pvBuffer, size_t xSize, FF_FILE *pxStream,
+                     size_t *pxWritten) {
+    *pxWritten = 0;
+    return stream_write(STREAM(pxStream), pvBuffer, xSize, pxWritten);
+}
 size_t ff_fread(void *pvBuffer, size_t xSize, size_t xItems,
                 FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
@@ -168,13 +392,18 @@ size_t ff_fread(void *pvBuffer, size_t xSize, size_t xItems,
     //  UINT btr,    /* [IN] Number of bytes to read */
     //  UINT* br     /* [OUT] Number of bytes read */
     //);
-    UINT br = 0;
-    FRESULT fr = f_read(pxStream, pvBuffer, xSize * xItems, &br);
+    size_t br = 0;
+    FRESULT fr = ff_fread_fr(pvBuffer, xSize * xItems, pxStream, &br);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
     return br / xSize;
 }
+FRESULT ff_fread_fr(void *pvBuffer, size_t xSize, FF_FILE *pxStream,
+                    size_t *pxRead) {
+    *pxRead = 0;
+    return stream_read(STREAM(pxStream), pvBuffer, xSize, pxRead);
+}
 int ff_chdir(const char *pcDirectoryName) {
     TRACE_PRINTF("%s\n", __func__);
     // FRESULT f_chdir (
@@ -237,10 +466,16 @@ int ff_fputc(int iChar, FF_FILE *pxStream) {
     //  UINT* bw          /* [OUT] Pointer to the variable to return number of
     //  bytes written */
     //);
-    UINT bw = 0;
+    stream_t *s = STREAM(pxStream);
+    if (s->writing && s->len < s->size &&
+        (FF_IOFBF == s->mode || '\n' != iChar)) {
+        s->buf[s->len++] = iChar;  // Fast path
+        return iChar;
+    }
+    size_t bw = 0;
     uint8_t buff[1];
     buff[0] = iChar;
-    FRESULT fr = f_write(pxStream, buff, 1, &bw);
+    FRESULT fr = stream_write(s, buff, 1, &bw);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -261,9 +496,11 @@ int ff_fgetc(FF_FILE *pxStream) {
     //  UINT btr,    /* [IN] Number of bytes to read */
     //  UINT* br     /* [OUT] Number of bytes read */
     //);
+    stream_t *s = STREAM(pxStream);
+    if (!s->writing && s->pos < s->len) return s->buf[s->pos++];  // Fast path
     uint8_t buff[1] = {0};
-    UINT br;
-    FRESULT fr = f_read(pxStream, buff, 1, &br);
+    size_t br;
+    FRESULT fr = stream_read(s, buff, 1, &br);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -304,63 +541,59 @@ long ff_ftell(FF_FILE *pxStream) {
     // FSIZE_t f_tell (
     //  FIL* fp   /* [IN] File object */
     //);
-    FSIZE_t pos = f_tell(pxStream);
+    FSIZE_t pos = stream_tell(STREAM(pxStream));
     myASSERT(pos < LONG_MAX);
     return pos;
 }
 int ff_fseek(FF_FILE *pxStream, int iOffset, int iWhence) {
     TRACE_PRINTF("%s\n", __func__);
-    FRESULT fr = -1;
+    FRESULT fr = ff_fseek_fr(pxStream, iOffset, iWhence);
+    errno = fresult2errno(fr);
+    if (FR_OK == fr)
+        return 0;
+    else
+        return -1;
+}
+FRESULT ff_fseek_fr(FF_FILE *pxStream, int iOffset, int iWhence) {
+    stream_t *s = STREAM(pxStream);
+    FSIZE_t pos = 0;
     switch (iWhence) {
         case FF_SEEK_CUR:  // The current file position.
-            if ((int)f_tell(pxStream) + iOffset < 0) return -1;
-            fr = f_lseek(pxStream, f_tell(pxStream) + iOffset);
+            pos = stream_tell(s);
             break;
         case FF_SEEK_END:  // The end of the file.
-            if ((int)f_size(pxStream) + iOffset < 0) return -1;
-            fr = f_lseek(pxStream, f_size(pxStream) + iOffset);
+            pos = ff_filelength(pxStream);
             break;
         case FF_SEEK_SET:  // The beginning of the file.
-            if (iOffset < 0) return -1;
-            fr = f_lseek(pxStream, iOffset);
             break;
         default:
             myASSERT(!"Bad iWhence");
+            return FR_INVALID_PARAMETER;
     }
-    errno = fresult2errno(fr);
-    if (FR_OK == fr)
-        return 0;
-    else
-        return -1;
+    if ((int)pos + iOffset < 0) return FR_INVALID_PARAMETER;
+    FRESULT fr = drain(s);
+    if (FR_OK == fr) fr = f_lseek(pxStream, pos + iOffset);
+    return fr;
 }
-int ff_findfirst(const char *pcDirectory, FF_FindData_t *pxFindData) {
-    TRACE_PRINTF("%s(%s)\n", __func__, pcDirectory);
-    // FRESULT f_findfirst (
-    //  DIR* dp,              /* [OUT] Poninter to the directory object */
-    //  FILINFO* fno,         /* [OUT] Pointer to the file information structure
-    //  */ const TCHAR* path,    /* [IN] Pointer to the directory name to be
-    //  opened */ const TCHAR* pattern  /* [IN] Pointer to the matching pattern
-    //  string */
-    //);
-    char buf1[ffconfigMAX_FILENAME] = {0};
+static int find_first(const char *pcDirectory, FF_FindData_t *pxFindData,
+                      find_bufs_t *bufs) {
     if (pcDirectory[0]) {
-        FRESULT fr = f_getcwd(buf1, sizeof buf1);
+        FRESULT fr = f_getcwd(bufs->cwd, sizeof bufs->cwd);
         errno = fresult2errno(fr);
         if (FR_OK != fr) return -1;
         fr = f_chdir(pcDirectory);
         errno = fresult2errno(fr);
         if (FR_OK != fr) return -1;
     }
-    char buf2[ffconfigMAX_FILENAME] = {0};
-    FRESULT fr = f_getcwd(buf2, sizeof buf2);
-    TRACE_PRINTF("%s: f_findfirst(path=%s)\n", __func__, buf2);
-    fr = f_findfirst(&pxFindData->dir, &pxFindData->fileinfo, buf2, "*");
+    FRESULT fr = f_getcwd(bufs->dir, sizeof bufs->dir);
+    TRACE_PRINTF("%s: f_findfirst(path=%s)\n", __func__, bufs->dir);
+    fr = f_findfirst(&pxFindData->dir, &pxFindData->fileinfo, bufs->dir, "*");
     errno = fresult2errno(fr);
     pxFindData->pcFileName = pxFindData->fileinfo.fname;
     pxFindData->ulFileSize = pxFindData->fileinfo.fsize;
     TRACE_PRINTF("%s: fname=%s\n", __func__, pxFindData->fileinfo.fname);
     if (pcDirectory[0]) {
-        FRESULT fr2 = f_chdir(buf1);
+        FRESULT fr2 = f_chdir(bufs->cwd);
         errno = fresult2errno(fr2);
         if (FR_OK != fr2) return -1;
     }
@@ -369,6 +602,24 @@ int ff_findfirst(const char *pcDirectory, FF_FindData_t *pxFindData) {
     else
         return -1;
 }
+int ff_findfirst(const char *pcDirectory, FF_FindData_t *pxFindData) {
+    TRACE_PRINTF("%s(%s)\n", __func__, pcDirectory);
+    // FRESULT f_findfirst (
+    //  DIR* dp,              /* [OUT] Poninter to the directory object */
+    //  FILINFO* fno,         /* [OUT] Pointer to the file information structure
+    //  */ const TCHAR* path,    /* [IN] Pointer to the directory name to be
+    //  opened */ const TCHAR* pattern  /* [IN] Pointer to the matching pattern
+    //  string */
+    //);
+    find_bufs_t *bufs = pool_alloc(FIND_POOL, sizeof(find_bufs_t));
+    if (!bufs) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int rc = find_first(pcDirectory, pxFindData, bufs);
+    pool_free(FIND_POOL, bufs);
+    return rc;
+}
 int ff_findnext(FF_FindData_t *pxFindData) {
     TRACE_PRINTF("%s\n", __func__);
     // FRESULT f_findnext (
@@ -387,14 +638,17 @@ int ff_findnext(FF_FindData_t *pxFindData) {
         return -1;
     }
 }
+// Close a stream that isn't going to be returned, keeping errno
+static FF_FILE *discard(FF_FILE *pxStream) {
+    int e = errno;
+    ff_fclose(pxStream);
+    errno = e;
+    return NULL;
+}
 FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
     TRACE_PRINTF("%s\n", __func__);
-    FIL *fp = malloc(sizeof(FIL));
-    if (!fp) {
-        errno = ENOMEM;
-        return NULL;
-    }
-    FRESULT fr = f_open(fp, pcFileName, FA_OPEN_APPEND | FA_WRITE);
+    FRESULT fr;
+    FIL *fp = stream_open(pcFileName, FA_OPEN_APPEND | FA_WRITE, &fr);
     if (FR_OK != fr)
         printf("%s: f_open error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -406,13 +660,13 @@ FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
         if (FR_OK != fr)
             TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
         errno = fresult2errno(fr);
-        if (1 != bw) return NULL;
+        if (1 != bw) return discard(fp);
     }
     fr = f_lseek(fp, lTruncateSize);
     errno = fresult2errno(fr);
     if (FR_OK != fr)
         printf("%s: f_lseek error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
-    if (FR_OK != fr) return NULL;
+    if (FR_OK != fr) return discard(fp);
     fr = f_truncate(fp);
     if (FR_OK != fr)
         printf("%s: f_truncate error: %s (%d)\n", __func__, FRESULT_str(fr),
@@ -421,11 +675,12 @@ FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
     if (FR_OK == fr)
         return fp;
     else
-        return NULL;
+        return discard(fp);
 }
 int ff_seteof(FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
-    FRESULT fr = f_truncate(pxStream);
+    FRESULT fr = drain(STREAM(pxStream));
+    if (FR_OK == fr) fr = f_truncate(pxStream);
     errno = fresult2errno(fr);
     if (FR_OK == fr)
         return 0;
@@ -451,7 +706,17 @@ int ff_rename(const char *pcOldName, const char *pcNewName,
 }
 char *ff_fgets(char *pcBuffer, size_t xCount, FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
-    TCHAR *p = f_gets(pcBuffer, xCount, pxStream);
+    // Not f_gets: it would bypass the stream's buffer
+    char *p = NULL;
+    size_t n = 0;
+    while (n + 1 < xCount) {
+        int c = ff_fgetc(pxStream);
+        if (FF_EOF == c) break;
+        pcBuffer[n++] = c;
+        if ('\n' == c) break;
+    }
+    if (xCount) pcBuffer[n] = 0;
+    if (n) p = pcBuffer;
     // On success a pointer to pcBuffer is returned. If there is a read error
     // then NULL is returned and the task's errno is set to indicate the reason.
     if (p == pcBuffer)
@@ -461,3 +726,80 @@ char *ff_fgets(char *pcBuffer, size_t xCount, FF_FILE *pxStream) {
         return NULL;
     }
 }
+int ff_fflush(FF_FILE *pxStream) {
+    TRACE_PRINTF("%s\n", __func__);
+    // FRESULT f_sync (
+    //  FIL* fp     /* [IN] File object */
+    //);
+    FRESULT fr = ff_fflush_fr(pxStream);
+    if (FR_OK != fr)
+        TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
+    errno = fresult2errno(fr);
+    if (FR_OK == fr)
+        return 0;
+    else
+        return -1;
+}
+FRESULT ff_fflush_fr(FF_FILE *pxStream) {
+    FRESULT fr = drain(STREAM(pxStream));
+    if (FR_OK == fr) fr = f_sync(pxStream);
+    return fr;
+}
+int ff_setvbuf(FF_FILE *pxStream, char *pcBuffer, int iMode, size_t xSize) {
+    TRACE_PRINTF("%s\n", __func__);
+    stream_t *s = STREAM(pxStream);
+    if ((FF_IOFBF != iMode && FF_IOLBF != iMode && FF_IONBF != iMode) ||
+        (FF_IONBF != iMode && !xSize)) {
+        errno = EINVAL;
+        return -1;
+    }
+    FRESULT fr = drain(s);
+    errno = fresult2errno(fr);
+    if (FR_OK != fr) return -1;
+    if (s->own_buf) free(s->buf);
+    s->buf = NULL;
+    s->size = 0;
+    s->own_buf = false;
+    s->mode = FF_IONBF;
+    if (FF_IONBF == iMode) return 0;
+    if (!pcBuffer) {
+        pcBuffer = malloc(xSize);
+        if (!pcBuffer) {
+            errno = ENOMEM;
+            return -1;
+        }
+        s->own_buf = true;
+    }
+    s->buf = (uint8_t *)pcBuffer;
+    s->size = xSize;
+    s->mode = iMode;
+    return 0;
+}
+void ff_rewind(FF_FILE *pxStream) {
+    TRACE_PRINTF("%s\n", __func__);
+    ff_fseek(pxStream, 0, FF_SEEK_SET);
+}
+size_t ff_filelength(FF_FILE *pxStream) {
+    TRACE_PRINTF("%s\n", __func__);
+    stream_t *s = STREAM(pxStream);
+    FSIZE_t size = f_size(pxStream);
+    // Buffered output can extend the file
+    if (s->writing && f_tell(pxStream) + s->len > size)
+        size = f_tell(pxStream) + s->len;
+    return size;
+}
+int ff_feof(FF_FILE *pxStream) {
+    TRACE_PRINTF("%s\n", __func__);
+    return stream_tell(STREAM(pxStream)) >= ff_filelength(pxStream);
+}
+void ff_stdio_get_pool_stats(obj_pool_stats_t *streams,
+                             obj_pool_stats_t *find_bufs) {
+    memset(streams, 0, sizeof *streams);
+    memset(find_bufs, 0, sizeof *find_bufs);
+#if FF_STDIO_STREAMS
+    obj_pool_get_stats(&stream_pool, streams);
+#endif
+#if FF_STDIO_FIND_BUFS
+    obj_pool_get_stats(&find_pool, find_bufs);
+#endif
+}
@@ -20,6 +20,9 @@ specific language governing permissions and limitations under the License.
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 #include <stdio.h>
+#include <string.h>
+//
+#include "pico/mutex.h"
 //
 #include "ff.h" /* Obtains integer types */
 //
@@ -32,6 +35,182 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf  // task_printf
 
+// Number of sectors in the write-back sector cache, divided evenly between
+// the drives. FatFs has only one sector window per volume, so a workload
+// that goes back and forth between FAT, directory and FSINFO sectors keeps
+// re-reading them. Only transfers to and from the window (ff_is_window) are
+// cached; file data goes straight through, so that it doesn't push the
+// metadata out and its writes aren't held back or reordered. 0 disables
+// the cache.
+#ifndef DISK_CACHE_SECTORS
+#define DISK_CACHE_SECTORS 0
+#endif
+
+#if DISK_CACHE_SECTORS
+
+typedef struct {
+    sd_card_t *p_sd;  // NULL if the entry is free
+    LBA_t sector;
+    uint32_t last_use;
+    bool dirty;
+    BYTE data[FF_MAX_SS];
+} cache_entry_t;
+
+// One drive's share of the cache. Each has its own lock, so that drives
+// can do I/O at the same time.
+typedef struct {
+    cache_entry_t *entries;
+    size_t count;    // 0 if there are more drives than sectors
+    uint32_t clock;  // Stamps last_use, for LRU replacement
+    mutex_t mutex;
+} cache_part_t;
+
+static cache_entry_t cache[DISK_CACHE_SECTORS];
+static cache_part_t cache_parts[FF_VOLUMES];
+
+// Called for each drive before any I/O on it
+static void cache_part_init(BYTE pdrv) {
+    cache_part_t *part = &cache_parts[pdrv];
+    if (mutex_is_initialized(&part->mutex)) return;
+    size_t count = count_of(cache) / sd_get_num();
+    part->entries = cache + pdrv * count;
+    part->count = count;
+    mutex_init(&part->mutex);
+}
+
+static cache_entry_t *cache_find(cache_part_t *part, sd_card_t *p_sd,
+                                 LBA_t sector) {
+    for (size_t i = 0; i < part->count; ++i)
+        if (part->entries[i].p_sd == p_sd && part->entries[i].sector == sector)
+            return &part->entries[i];
+    return NULL;
+}
+
+static int cache_write_back(cache_entry_t *e) {
+    if (!e->dirty) return SD_BLOCK_DEVICE_ERROR_NONE;
+    int rc = e->p_sd->write_blocks(e->p_sd, e->data, e->sector, 1);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        e->dirty = false;
+        ++e->p_sd->stats.cache_write_backs;
+    }
+    return rc;
+}
+
+// Find a free entry, or evict the least recently used
+static int cache_alloc(cache_part_t *part, cache_entry_t **e_p) {
+    cache_entry_t *lru = &part->entries[0];
+    for (size_t i = 0; i < part->count; ++i) {
+        cache_entry_t *e = &part->entries[i];
+        if (!e->p_sd) {
+            lru = e;
+            break;
+        }
+        if (part->clock - e->last_use > part->clock - lru->last_use) lru = e;
+    }
+    if (lru->p_sd) {
+        int rc = cache_write_back(lru);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+        lru->p_sd = NULL;
+    }
+    *e_p = lru;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int cache_read(cache_part_t *part, sd_card_t *p_sd, BYTE *buff,
+                      LBA_t sector, UINT count) {
+    if (1 == count && ff_is_window(buff)) {
+        cache_entry_t *e = cache_find(part, p_sd, sector);
+        if (e) {
+            ++p_sd->stats.cache_hits;
+        } else {
+            ++p_sd->stats.cache_misses;
+            int rc = cache_alloc(part, &e);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+            rc = p_sd->read_blocks(p_sd, e->data, sector, 1);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+            e->p_sd = p_sd;
+            e->sector = sector;
+            e->dirty = false;
+        }
+        e->last_use = ++part->clock;
+        memcpy(buff, e->data, FF_MAX_SS);
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    int rc = p_sd->read_blocks(p_sd, buff, sector, count);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    // Cached copies of sectors in the range may be newer than the card's
+    for (size_t i = 0; i < part->count; ++i) {
+        cache_entry_t *e = &part->entries[i];
+        if (e->p_sd == p_sd && e->dirty && sector <= e->sector &&
+            e->sector < sector + count)
+            memcpy(buff + (e->sector - sector) * FF_MAX_SS, e->data,
+                   FF_MAX_SS);
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int cache_write(cache_part_t *part, sd_card_t *p_sd, const BYTE *buff,
+                       LBA_t sector, UINT count) {
+    if (1 == count && ff_is_window(buff)) {
+        cache_entry_t *e = cache_find(part, p_sd, sector);
+        if (!e) {
+            int rc = cache_alloc(part, &e);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+            e->p_sd = p_sd;
+            e->sector = sector;
+        }
+        e->last_use = ++part->clock;
+        e->dirty = true;
+        memcpy(e->data, buff, FF_MAX_SS);
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    int rc = p_sd->write_blocks(p_sd, buff, sector, count);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    // Bring cached copies of sectors in the range up to date
+    for (size_t i = 0; i < part->count; ++i) {
+        cache_entry_t *e = &part->entries[i];
+        if (e->p_sd == p_sd && sector <= e->sector &&
+            e->sector < sector + count) {
+            memcpy(e->data, buff + (e->sector - sector) * FF_MAX_SS,
+                   FF_MAX_SS);
+            e->dirty = false;
+        }
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Write back the drive's dirty sectors, in ascending order
+static int cache_flush(cache_part_t *part, sd_card_t *p_sd) {
+    for (;;) {
+        cache_entry_t *next = NULL;
+        for (size_t i = 0; i < part->count; ++i) {
+            cache_entry_t *e = &part->entries[i];
+            if (e->p_sd == p_sd && e->dirty && (!next || e->sector < next->sector))
+                next = e;
+        }
+        if (!next) return SD_BLOCK_DEVICE_ERROR_NONE;
+        int rc = cache_write_back(next);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    }
+}
+
+// Drop the drive's cached sectors from start to end, inclusive,
+// without writing them back. Returns the number of dirty ones dropped.
+static uint32_t cache_invalidate(cache_part_t *part, sd_card_t *p_sd,
+                                 LBA_t start, LBA_t end) {
+    uint32_t dirty = 0;
+    for (size_t i = 0; i < part->count; ++i) {
+        cache_entry_t *e = &part->entries[i];
+        if (e->p_sd == p_sd && start <= e->sector && e->sector <= end) {
+            if (e->dirty) ++dirty;
+            e->p_sd = NULL;
+        }
+    }
+    return dirty;
+}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -59,6 +238,23 @@ DSTATUS disk_initialize(
 
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+#if DISK_CACHE_SECTORS
+    if (pdrv >= count_of(cache_parts)) return RES_PARERR;
+    cache_part_init(pdrv);
+    cache_part_t *part = &cache_parts[pdrv];
+    mutex_enter_blocking(&part->mutex);
+    // If the card is still up (e.g., f_mount again after f_unmount), finish
+    // writing to it. Otherwise, it might have been changed: what couldn't be
+    // written is lost, and counted in cache_discards.
+    if (!(p_sd->m_Status & (STA_NOINIT | STA_NODISK))) cache_flush(part, p_sd);
+    uint32_t lost = cache_invalidate(part, p_sd, 0, (LBA_t)-1);
+    mutex_exit(&part->mutex);
+    if (lost) {
+        DBG_PRINTF("%s: discarded %lu dirty cached sectors\n", __FUNCTION__,
+                   (unsigned long)lost);
+        p_sd->stats.cache_discards += lost;
+    }
+#endif
     // See http://elm-chan.org/fsw/ff/doc/dstat.html
     return p_sd->init(p_sd);  
 }
@@ -98,7 +294,19 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+#if DISK_CACHE_SECTORS
+    cache_part_t *part = &cache_parts[pdrv];
+    int rc;
+    if (part->count) {
+        mutex_enter_blocking(&part->mutex);
+        rc = cache_read(part, p_sd, buff, sector, count);
+        mutex_exit(&part->mutex);
+    } else {
+        rc = p_sd->read_blocks(p_sd, buff, sector, count);
+    }
+#else
     int rc = p_sd->read_blocks(p_sd, buff, sector, count);
+#endif
     return sdrc2dresult(rc);
 }
 
@@ -116,7 +324,19 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+#if DISK_CACHE_SECTORS
+    cache_part_t *part = &cache_parts[pdrv];
+    int rc;
+    if (part->count) {
+        mutex_enter_blocking(&part->mutex);
+        rc = cache_write(part, p_sd, buff, sector, count);
+        mutex_exit(&part->mutex);
+    } else {
+        rc = p_sd->write_blocks(p_sd, buff, sector, count);
+    }
+#else
     int rc = p_sd->write_blocks(p_sd, buff, sector, count);
+#endif
     return sdrc2dresult(rc);
 }
 
@@ -156,12 +376,41 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive nmuber (0..) */
                                 // f_mkfs function and it attempts to align data
                                 // area on the erase block boundary. It is
                                 // required when FF_USE_MKFS == 1.
-            static DWORD bs = 1;
+            // Use the card's allocation unit, from its SD Status
+            DWORD bs = 1;
+            while (bs < 32768 && bs * 2 <= p_sd->au_size) bs *= 2;
             *(DWORD *)buff = bs;
             return RES_OK;
         }
-        case CTRL_SYNC:
-            return RES_OK;
+        case CTRL_SYNC: {  // Complete pending write process
+#if DISK_CACHE_SECTORS
+            cache_part_t *part = &cache_parts[pdrv];
+            if (part->count) {
+                mutex_enter_blocking(&part->mutex);
+                int rc = cache_flush(part, p_sd);
+                mutex_exit(&part->mutex);
+                if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return sdrc2dresult(rc);
+            }
+#endif
+            return sdrc2dresult(p_sd->sync(p_sd));
+        }
+        case CTRL_TRIM: {  // Informs the device the data on the block of
+                           // sectors is no longer needed and it can be
+                           // erased. The sector block is specified in an
+                           // LBA_t array {<Start LBA>, <End LBA>} pointed by
+                           // buff. This command is used by f_unlink and
+                           // f_truncate when FF_USE_TRIM == 1.
+            LBA_t *range = (LBA_t *)buff;
+#if DISK_CACHE_SECTORS
+            cache_part_t *part = &cache_parts[pdrv];
+            if (part->count) {
+                mutex_enter_blocking(&part->mutex);
+                cache_invalidate(part, p_sd, range[0], range[1]);
+                mutex_exit(&part->mutex);
+            }
+#endif
+            return sdrc2dresult(p_sd->erase_blocks(p_sd, range[0], range[1]));
+        }
         default:
             return RES_PARERR;
     }
@@ -0,0 +1,218 @@
+/* io_engine.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// See io_engine.h
+
+#include <errno.h>
+#include <string.h>
+//
+#include "hardware/sync.h"
+#if !IO_ENGINE_INLINE
+#include "pico/multicore.h"
+#endif
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff_stdio.h"
+#include "io_engine.h"
+#include "my_debug.h"
+
+#if IO_ENGINE_QUEUE_DEPTH & (IO_ENGINE_QUEUE_DEPTH - 1)
+#error IO_ENGINE_QUEUE_DEPTH must be a power of 2
+#endif
+
+// Single producer, single consumer ring of requests. The producer only
+// writes head, the consumer only writes tail; the fences order the slot
+// accesses with respect to publishing the new index to the other core.
+typedef struct {
+    io_request_t *slot[IO_ENGINE_QUEUE_DEPTH];
+    volatile uint32_t head;  // Count of requests put
+    volatile uint32_t tail;  // Count of requests got
+} ring_t;
+
+static ring_t submissions;  // Core 0 to core 1
+static ring_t completions;  // Core 1 to core 0
+static volatile bool running, stopping;
+static uint32_t in_flight;  // Core 0 only
+static io_engine_stats_t stats;  // Core 0 only
+
+static bool ring_put(ring_t *ring, io_request_t *req) {
+    uint32_t head = ring->head;
+    if (head - ring->tail == IO_ENGINE_QUEUE_DEPTH) return false;
+    ring->slot[head % IO_ENGINE_QUEUE_DEPTH] = req;
+    __mem_fence_release();  // Slot (and request) before head
+    ring->head = head + 1;
+    return true;
+}
+
+static io_request_t *ring_get(ring_t *ring) {
+    uint32_t tail = ring->tail;
+    if (tail == ring->head) return NULL;
+    __mem_fence_acquire();  // Head before slot (and request)
+    io_request_t *req = ring->slot[tail % IO_ENGINE_QUEUE_DEPTH];
+    __mem_fence_release();  // Done with the slot before handing it back
+    ring->tail = tail + 1;
+    return req;
+}
+
+// errno is shared with core 0, so the error comes from the FatFs result
+static void serve(io_request_t *req) {
+    req->start_us = time_us_64();
+    req->result = 0;
+    FRESULT fr;
+    switch (req->op) {
+        case IO_OPEN:
+            req->file = ff_fopen_fr(req->path, req->mode, &fr);
+            break;
+        case IO_CLOSE:
+            fr = ff_fclose_fr(req->file);
+            break;
+        case IO_READ:
+            fr = ff_fread_fr(req->buf, req->len, req->file, &req->result);
+            break;
+        case IO_WRITE:
+            fr = ff_fwrite_fr(req->buf, req->len, req->file, &req->result);
+            break;
+        case IO_SEEK:
+            fr = ff_fseek_fr(req->file, req->offset, req->whence);
+            break;
+        case IO_SYNC:
+            fr = ff_fflush_fr(req->file);
+            break;
+        default:
+            fr = FR_INVALID_PARAMETER;
+    }
+    if (FR_INVALID_PARAMETER == fr)
+        req->error = EINVAL;
+    else
+        req->error = fresult2errno(fr);
+    req->finish_us = time_us_64();
+}
+
+#if !IO_ENGINE_INLINE
+static void core1_loop() {
+    for (;;) {
+        io_request_t *req;
+        while ((req = ring_get(&submissions))) {
+            serve(req);
+            // Can't be full: there are never more than
+            // IO_ENGINE_QUEUE_DEPTH requests in flight
+            bool ok = ring_put(&completions, req);
+            myASSERT(ok);
+            (void)ok;
+        }
+        if (stopping) break;
+        // Sleep until the doorbell. A ring after the queue was found empty
+        // is still in the FIFO, so it can't be missed.
+        multicore_fifo_pop_blocking();
+    }
+    __mem_fence_release();
+    running = false;
+}
+
+static void ring_doorbell() {
+    // If the FIFO is full, core 1 has wake ups pending anyway
+    if (multicore_fifo_wready()) multicore_fifo_push_blocking(0);
+}
+#endif
+
+bool io_engine_start() {
+    if (running) return false;
+#if !IO_ENGINE_INLINE
+    if (!core1_claim("I/O engine")) return false;
+#endif
+    memset(&submissions, 0, sizeof submissions);
+    memset(&completions, 0, sizeof completions);
+    in_flight = 0;
+    stopping = false;
+    running = true;
+#if !IO_ENGINE_INLINE
+    multicore_reset_core1();
+    multicore_launch_core1(core1_loop);
+#endif
+    return true;
+}
+
+bool io_engine_running() { return running && !stopping; }
+
+void io_engine_stop() {
+    if (!running) return;
+    while (in_flight) io_engine_poll();
+    stopping = true;
+#if IO_ENGINE_INLINE
+    running = false;
+#else
+    ring_doorbell();
+    while (running) tight_loop_contents();
+    __mem_fence_acquire();
+    core1_release();
+#endif
+}
+
+bool io_engine_submit(io_request_t *req) {
+    if (!running || stopping || in_flight == IO_ENGINE_QUEUE_DEPTH) {
+        ++stats.rejected;
+        return false;
+    }
+    req->done = false;
+    req->submit_us = time_us_64();
+#if IO_ENGINE_INLINE
+    serve(req);
+    bool ok = ring_put(&completions, req);
+#else
+    bool ok = ring_put(&submissions, req);
+#endif
+    myASSERT(ok);
+    (void)ok;
+    ++in_flight;
+    ++stats.submitted;
+    if (in_flight > stats.max_depth) stats.max_depth = in_flight;
+#if !IO_ENGINE_INLINE
+    ring_doorbell();
+#endif
+    return true;
+}
+
+static void account(const io_request_t *req) {
+    uint32_t wait_us = req->start_us - req->submit_us;
+    uint32_t service_us = req->finish_us - req->start_us;
+    uint32_t latency_us = req->finish_us - req->submit_us;
+    ++stats.completed;
+    if (req->error) ++stats.errors;
+    stats.total_wait_us += wait_us;
+    stats.total_service_us += service_us;
+    if (wait_us > stats.max_wait_us) stats.max_wait_us = wait_us;
+    if (service_us > stats.max_service_us) stats.max_service_us = service_us;
+    if (latency_us > stats.max_latency_us) stats.max_latency_us = latency_us;
+}
+
+unsigned io_engine_poll() {
+    unsigned count = 0;
+    io_request_t *req;
+    while ((req = ring_get(&completions))) {
+        --in_flight;
+        ++count;
+        account(req);
+        req->done = true;
+        if (req->callback) req->callback(req);
+    }
+    return count;
+}
+
+unsigned io_engine_in_flight() { return in_flight; }
+
+void io_engine_get_stats(io_engine_stats_t *stats_p) { *stats_p = stats; }
+
+void io_engine_reset_stats() { memset(&stats, 0, sizeof stats); }
+
+/* [] END OF FILE */
@@ -0,0 +1,64 @@
+/* obj_pool.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// See obj_pool.h
+
+#include <string.h>
+//
+#include "obj_pool.h"
+#include "my_debug.h"
+
+void *obj_pool_alloc(obj_pool_t *pool) {
+    void *obj = NULL;
+    mutex_enter_blocking(pool->mutex);
+    if (pool->free_list) {
+        // A freed object holds the link to the next. Objects needn't be
+        // aligned for a pointer (e.g., arrays of char), hence memcpy.
+        obj = pool->free_list;
+        memcpy(&pool->free_list, obj, sizeof(void *));
+    } else if (pool->fresh < pool->capacity) {
+        obj = pool->mem + pool->fresh++ * pool->block_size;
+    }
+    if (obj) {
+        ++pool->stats.allocs;
+        if (++pool->stats.in_use > pool->stats.high_water)
+            pool->stats.high_water = pool->stats.in_use;
+    } else {
+        ++pool->stats.exhausted;
+    }
+    mutex_exit(pool->mutex);
+    return obj;
+}
+
+void obj_pool_free(obj_pool_t *pool, void *obj) {
+    myASSERT(obj_pool_owns(pool, obj));
+    myASSERT(0 == ((uint8_t *)obj - pool->mem) % pool->block_size);
+    mutex_enter_blocking(pool->mutex);
+    memcpy(obj, &pool->free_list, sizeof(void *));
+    pool->free_list = obj;
+    --pool->stats.in_use;
+    mutex_exit(pool->mutex);
+}
+
+bool obj_pool_owns(const obj_pool_t *pool, const void *obj) {
+    const uint8_t *p = obj;
+    return pool->mem <= p && p < pool->mem + pool->capacity * pool->block_size;
+}
+
+void obj_pool_get_stats(obj_pool_t *pool, obj_pool_stats_t *stats) {
+    mutex_enter_blocking(pool->mutex);
+    *stats = pool->stats;
+    mutex_exit(pool->mutex);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,409 @@
+/* aio_host_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Host test of the I/O engine and ff_aio: the real io_engine.c and ff_aio.c
+// run against in-memory files (the ff_stdio functions below) and the Pico
+// SDK stand-ins in host/, with core 1 as a thread. Checks that requests are
+// served and completed in submission order, that a full queue is refused
+// with EAGAIN, that ff_aio_suspend waits and times out, and that errors
+// are reported.
+//
+// Build and run, from this directory, with core 1 and with IO_ENGINE_INLINE:
+//   cc -O2 -pthread -Ihost -I../include -I../ff15/source -o aio_host_test aio_host_test.c host/pico_host.c ../src/io_engine.c ../src/ff_aio.c && ./aio_host_test
+//   cc -O2 -pthread -DIO_ENGINE_INLINE=1 -Ihost -I../include -I../ff15/source -o aio_host_test aio_host_test.c host/pico_host.c ../src/io_engine.c ../src/ff_aio.c && ./aio_host_test
+// Prints OK and exits with 0 if all is well.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff_aio.h"
+#include "ff_stdio.h"
+
+#define CHUNK 1000
+#define MAX_FILES 4
+#define FILE_SIZE (IO_ENGINE_QUEUE_DEPTH * CHUNK)
+
+static int failures;
+
+#define CHECK(cond, fmt, args...)                                     \
+    if (!(cond)) {                                                    \
+        printf("FAILED (line %d): " fmt "\n", __LINE__, ##args);      \
+        ++failures;                                                   \
+    }
+
+void my_printf(const char *pcFormat, ...) {
+    va_list args;
+    va_start(args, pcFormat);
+    vprintf(pcFormat, args);
+    va_end(args);
+}
+void my_assert_func(const char *file, int line, const char *func,
+                    const char *pred) {
+    printf("assertion \"%s\" failed: file \"%s\", line %d, function: %s\n",
+           pred, file, line, func);
+    abort();
+}
+
+/* Core 1 ownership (f_util.h) */
+
+static bool core1_busy;  // Pretend something else has core 1
+
+bool core1_claim(const char *owner) {
+    (void)owner;
+    if (core1_busy) return false;
+    core1_busy = true;
+    return true;
+}
+void core1_release() { core1_busy = false; }
+
+/* In-memory files for the ff_stdio functions the engine uses */
+
+typedef struct {
+    char path[32];
+    uint8_t data[FILE_SIZE];
+    size_t size;
+} mem_file_t;
+
+typedef struct {
+    mem_file_t *mf;
+    size_t pos;
+    bool writable;
+} stream_t;
+
+static mem_file_t files[MAX_FILES];
+static FIL handles[MAX_FILES];  // What the engine sees
+static stream_t streams[MAX_FILES];
+
+// A closed gate holds up writes on core 1, to fill the queue
+static pthread_mutex_t gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static bool gate_closed;
+
+static void set_gate(bool closed) {
+    pthread_mutex_lock(&gate_mutex);
+    gate_closed = closed;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_mutex);
+}
+static void pass_gate() {
+    pthread_mutex_lock(&gate_mutex);
+    while (gate_closed) pthread_cond_wait(&gate_cond, &gate_mutex);
+    pthread_mutex_unlock(&gate_mutex);
+}
+
+// Buffers in the order the engine wrote or read them
+static const void *served[4 * IO_ENGINE_QUEUE_DEPTH];
+static size_t served_count;
+static unsigned syncs;
+
+static void serve_log(const void *buf) {
+    if (served_count < count_of(served)) served[served_count] = buf;
+    ++served_count;
+    usleep(rand() % 200);  // Take a while, like a card
+}
+
+static stream_t *stream(FF_FILE *pxStream) {
+    size_t i = pxStream - handles;
+    if (i >= MAX_FILES || !streams[i].mf) return NULL;
+    return &streams[i];
+}
+
+FF_FILE *ff_fopen_fr(const char *pcFile, const char *pcMode, FRESULT *fr) {
+    mem_file_t *mf = NULL;
+    for (size_t i = 0; i < MAX_FILES && !mf; ++i)
+        if (!strcmp(files[i].path, pcFile)) mf = &files[i];
+    if (!mf && 'r' == pcMode[0]) {
+        *fr = FR_NO_FILE;
+        return NULL;
+    }
+    for (size_t i = 0; i < MAX_FILES && !mf; ++i)
+        if (!files[i].path[0]) {
+            mf = &files[i];
+            snprintf(mf->path, sizeof mf->path, "%s", pcFile);
+        }
+    for (size_t i = 0; i < MAX_FILES && mf; ++i)
+        if (!streams[i].mf) {
+            if ('w' == pcMode[0]) mf->size = 0;
+            streams[i].mf = mf;
+            streams[i].pos = 0;
+            streams[i].writable = 'r' != pcMode[0] || strchr(pcMode, '+');
+            *fr = FR_OK;
+            return &handles[i];
+        }
+    *fr = FR_TOO_MANY_OPEN_FILES;
+    return NULL;
+}
+FRESULT ff_fclose_fr(FF_FILE *pxStream) {
+    stream_t *s = stream(pxStream);
+    if (!s) return FR_INVALID_OBJECT;
+    s->mf = NULL;
+    return FR_OK;
+}
+FRESULT ff_fwrite_fr(const void *pvBuffer, size_t xSize, FF_FILE *pxStream,
+                     size_t *pxWritten) {
+    *pxWritten = 0;
+    stream_t *s = stream(pxStream);
+    if (!s) return FR_INVALID_OBJECT;
+    if (!s->writable) return FR_DENIED;
+    pass_gate();
+    serve_log(pvBuffer);
+    if (xSize > FILE_SIZE - s->pos) xSize = FILE_SIZE - s->pos;
+    memcpy(s->mf->data + s->pos, pvBuffer, xSize);
+    s->pos += xSize;
+    if (s->pos > s->mf->size) s->mf->size = s->pos;
+    *pxWritten = xSize;
+    return FR_OK;
+}
+FRESULT ff_fread_fr(void *pvBuffer, size_t xSize, FF_FILE *pxStream,
+                    size_t *pxRead) {
+    *pxRead = 0;
+    stream_t *s = stream(pxStream);
+    if (!s) return FR_INVALID_OBJECT;
+    serve_log(pvBuffer);
+    if (xSize > s->mf->size - s->pos) xSize = s->mf->size - s->pos;
+    memcpy(pvBuffer, s->mf->data + s->pos, xSize);
+    s->pos += xSize;
+    *pxRead = xSize;
+    return FR_OK;
+}
+FRESULT ff_fseek_fr(FF_FILE *pxStream, int iOffset, int iWhence) {
+    stream_t *s = stream(pxStream);
+    if (!s) return FR_INVALID_OBJECT;
+    long pos = iOffset;
+    if (FF_SEEK_CUR == iWhence) pos += s->pos;
+    if (FF_SEEK_END == iWhence) pos += s->mf->size;
+    if (pos < 0 || pos > FILE_SIZE) return FR_INVALID_PARAMETER;
+    s->pos = pos;
+    return FR_OK;
+}
+FRESULT ff_fflush_fr(FF_FILE *pxStream) {
+    if (!stream(pxStream)) return FR_INVALID_OBJECT;
+    ++syncs;
+    return FR_OK;
+}
+int fresult2errno(FRESULT fr) {
+    switch (fr) {
+        case FR_OK:
+            return 0;
+        case FR_NO_FILE:
+            return ENOENT;
+        case FR_DENIED:
+            return EACCES;
+        case FR_INVALID_OBJECT:
+            return EBADF;
+        case FR_TOO_MANY_OPEN_FILES:
+            return ENFILE;
+        case FR_INVALID_PARAMETER:
+            return EINVAL;
+        default:
+            return EIO;
+    }
+}
+
+/* Tests */
+
+static ff_aiocb_t cbs[IO_ENGINE_QUEUE_DEPTH + 1];
+static uint8_t bufs[IO_ENGINE_QUEUE_DEPTH][CHUNK];
+
+static void fill(size_t i) {
+    for (size_t j = 0; j < CHUNK; ++j) bufs[i][j] = (uint8_t)(i * 7 + j);
+}
+static bool filled(size_t i) {
+    for (size_t j = 0; j < CHUNK; ++j)
+        if (bufs[i][j] != (uint8_t)(i * 7 + j)) return false;
+    return true;
+}
+
+// Wait for each of n requests with ff_aio_suspend
+static void wait_all(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        ff_aiocb_t *const list[] = {&cbs[i]};
+        while (EINPROGRESS == ff_aio_error(&cbs[i]))
+            CHECK(0 == ff_aio_suspend(list, 1, 0), "ff_aio_suspend: %d", errno);
+    }
+}
+
+// Carry out a request synchronously through the engine
+static int request(io_request_t *req) {
+    if (!io_engine_submit(req)) return EAGAIN;
+    ff_aiocb_t *const list[] = {req};
+    while (!req->done) ff_aio_suspend(list, 1, 0);
+    return req->error;
+}
+
+static FIL *open_file(const char *path, const char *mode) {
+    io_request_t req = {.op = IO_OPEN, .path = path, .mode = mode};
+    int error = request(&req);
+    CHECK(!error, "open %s: %d", path, error);
+    return req.file;
+}
+
+static void close_file(FIL *file) {
+    io_request_t req = {.op = IO_CLOSE, .file = file};
+    int error = request(&req);
+    CHECK(!error, "close: %d", error);
+}
+
+// Writes and reads queued together are served and completed in order
+static void test_order() {
+    FIL *file = open_file("order", "w+");
+    served_count = 0;
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i) {
+        fill(i);
+        CHECK(0 == ff_aio_write(file, bufs[i], CHUNK, &cbs[i]),
+              "ff_aio_write %zu: %d", i, errno);
+    }
+    wait_all(IO_ENGINE_QUEUE_DEPTH);
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i) {
+        CHECK(0 == ff_aio_error(&cbs[i]), "write %zu: error %d", i,
+              ff_aio_error(&cbs[i]));
+        CHECK(CHUNK == ff_aio_return(&cbs[i]), "write %zu: returned %zd", i,
+              ff_aio_return(&cbs[i]));
+        CHECK(served[i] == bufs[i], "write %zu served out of order", i);
+    }
+    CHECK(FILE_SIZE == files[0].size, "file size %zu", files[0].size);
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i) {
+        memcpy(bufs[i], files[0].data + i * CHUNK, CHUNK);
+        CHECK(filled(i), "chunk %zu of the file is wrong", i);
+    }
+
+    unsigned syncs_before = syncs;
+    CHECK(0 == ff_aio_fsync(file, &cbs[0]), "ff_aio_fsync: %d", errno);
+    wait_all(1);
+    CHECK(0 == ff_aio_error(&cbs[0]) && syncs == syncs_before + 1,
+          "ff_aio_fsync: error %d", ff_aio_error(&cbs[0]));
+
+    io_request_t seek = {.op = IO_SEEK, .file = file, .whence = FF_SEEK_SET};
+    CHECK(!request(&seek), "seek: %d", seek.error);
+    memset(bufs, 0, sizeof bufs);
+    served_count = 0;
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i)
+        CHECK(0 == ff_aio_read(file, bufs[i], CHUNK, &cbs[i]),
+              "ff_aio_read %zu: %d", i, errno);
+    wait_all(IO_ENGINE_QUEUE_DEPTH);
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i) {
+        CHECK(CHUNK == ff_aio_return(&cbs[i]), "read %zu: returned %zd", i,
+              ff_aio_return(&cbs[i]));
+        CHECK(served[i] == bufs[i], "read %zu served out of order", i);
+        CHECK(filled(i), "read %zu got the wrong data", i);
+    }
+    close_file(file);
+}
+
+// With IO_ENGINE_QUEUE_DEPTH requests outstanding, the next is refused
+static void test_full() {
+    FIL *file = open_file("full", "w");
+    io_engine_stats_t before, after;
+    io_engine_get_stats(&before);
+    if (!IO_ENGINE_INLINE) set_gate(true);  // Core 1 stalls on the first
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i)
+        CHECK(0 == ff_aio_write(file, bufs[i], CHUNK, &cbs[i]),
+              "ff_aio_write %zu: %d", i, errno);
+    errno = 0;
+    ff_aiocb_t *extra = &cbs[IO_ENGINE_QUEUE_DEPTH];
+    CHECK(-1 == ff_aio_write(file, bufs[0], CHUNK, extra) && EAGAIN == errno,
+          "ff_aio_write on a full queue: errno %d", errno);
+    CHECK(EAGAIN == ff_aio_error(extra), "refused request: error %d",
+          ff_aio_error(extra));
+    io_engine_get_stats(&after);
+    CHECK(after.rejected == before.rejected + 1, "rejected %u",
+          (unsigned)(after.rejected - before.rejected));
+
+    if (!IO_ENGINE_INLINE) {
+        // Nothing can finish while core 1 is held up
+        ff_aiocb_t *const list[] = {&cbs[0], &cbs[IO_ENGINE_QUEUE_DEPTH - 1]};
+        uint64_t start = time_us_64();
+        errno = 0;
+        CHECK(-1 == ff_aio_suspend(list, 2, 20000) && EAGAIN == errno,
+              "ff_aio_suspend didn't time out: errno %d", errno);
+        uint64_t elapsed = time_us_64() - start;
+        CHECK(elapsed >= 20000, "ff_aio_suspend returned after %llu us",
+              (unsigned long long)elapsed);
+        CHECK(EINPROGRESS == ff_aio_error(&cbs[0]), "request finished early");
+        set_gate(false);
+        CHECK(0 == ff_aio_suspend(list, 2, 0), "ff_aio_suspend: %d", errno);
+        CHECK(cbs[0].done, "ff_aio_suspend returned before the first finished");
+    }
+    wait_all(IO_ENGINE_QUEUE_DEPTH);
+    for (size_t i = 0; i < IO_ENGINE_QUEUE_DEPTH; ++i)
+        CHECK(0 == ff_aio_error(&cbs[i]), "write %zu: error %d", i,
+              ff_aio_error(&cbs[i]));
+    close_file(file);
+}
+
+// ff_aio_suspend on a request that isn't outstanding times out
+static void test_suspend_timeout() {
+    ff_aiocb_t idle;
+    memset(&idle, 0, sizeof idle);
+    ff_aiocb_t *const list[] = {NULL, &idle};
+    uint64_t start = time_us_64();
+    errno = 0;
+    CHECK(-1 == ff_aio_suspend(list, 2, 10000) && EAGAIN == errno,
+          "ff_aio_suspend: errno %d", errno);
+    CHECK(time_us_64() - start >= 10000, "ff_aio_suspend returned early");
+}
+
+static void test_errors() {
+    FIL *file = open_file("order", "r");
+    CHECK(0 == ff_aio_write(file, bufs[0], CHUNK, &cbs[0]), "ff_aio_write: %d",
+          errno);
+    errno = 0;
+    if (!cbs[0].done) {
+        CHECK(-1 == ff_aio_return(&cbs[0]) && EINVAL == errno,
+              "ff_aio_return before completion: errno %d", errno);
+    }
+    wait_all(1);
+    CHECK(EACCES == ff_aio_error(&cbs[0]), "write to a read only file: %d",
+          ff_aio_error(&cbs[0]));
+    CHECK(0 == ff_aio_return(&cbs[0]), "write to a read only file returned %zd",
+          ff_aio_return(&cbs[0]));
+    io_request_t seek = {.op = IO_SEEK, .file = file, .offset = -1,
+                         .whence = FF_SEEK_SET};
+    CHECK(EINVAL == request(&seek), "seek before the start: %d", seek.error);
+    close_file(file);
+
+    io_request_t open = {.op = IO_OPEN, .path = "missing", .mode = "r"};
+    CHECK(ENOENT == request(&open), "open a missing file: %d", open.error);
+
+    // Core 1 in use elsewhere: the engine can't start
+    io_engine_stop();
+    if (!IO_ENGINE_INLINE) {
+        core1_busy = true;
+        errno = 0;
+        CHECK(-1 == ff_aio_fsync(&handles[0], &cbs[0]) && ENOSYS == errno,
+              "ff_aio_fsync without core 1: errno %d", errno);
+        core1_busy = false;
+    }
+}
+
+int main() {
+    CHECK(io_engine_start(), "io_engine_start");
+    test_order();
+    test_full();
+    test_suspend_timeout();
+    test_errors();
+    io_engine_stop();
+    printf("%s (%s)\n", failures ? "FAILED" : "OK",
+           IO_ENGINE_INLINE ? "IO_ENGINE_INLINE" : "core 1 thread");
+    return failures ? 1 : 0;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,184 @@
+/* bin_log_decode.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Host tool: convert binary log files (see bin_log_format.h) to CSV.
+//
+// Build, from this directory:
+//   cc -O2 -I../include -I../sd_driver -o bin_log_decode bin_log_decode.c ../sd_driver/crc.c
+// Usage:
+//   bin_log_decode [-t <type>] <file>...
+// With -t, only records of that type are printed, under a header line made
+// from the column names in its type 0 record. Otherwise every record is
+// printed, with its type in the first column. Records of a type that has
+// not been described are printed in hex.
+// Assumes a little endian host.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//
+#include "bin_log_format.h"
+#include "crc.h"
+
+typedef struct {
+    char format[BIN_LOG_MAX_PAYLOAD + 1];
+    char columns[BIN_LOG_MAX_PAYLOAD + 1];
+} schema_t;
+
+static schema_t schemas[256];
+static int only_type = -1;
+static bool header_printed;
+
+static uint16_t get16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static size_t field_size(char c) {
+    switch (c) {
+        case 'b': case 'B': return 1;
+        case 'h': case 'H': return 2;
+        case 'i': case 'I': case 'f': case 't': return 4;
+        case 'q': case 'Q': case 'd': return 8;
+        default: return 0;
+    }
+}
+
+static void print_hex(const uint8_t *p, size_t len) {
+    for (size_t i = 0; i < len; ++i) printf("%02x", p[i]);
+}
+
+// Print the fields of a payload. Returns false if it doesn't fit the format.
+static bool print_fields(const char *format, const uint8_t *p, size_t len) {
+    size_t need = 0;
+    for (const char *f = format; *f; ++f) {
+        if (!field_size(*f)) return false;
+        need += field_size(*f);
+    }
+    if (need != len) return false;
+    for (const char *f = format; *f; ++f) {
+        if (f != format) putchar(',');
+        union {
+            int8_t b; uint8_t B; int16_t h; uint16_t H; int32_t i; uint32_t I;
+            int64_t q; uint64_t Q; float f; double d;
+        } v;
+        memcpy(&v, p, field_size(*f));
+        p += field_size(*f);
+        switch (*f) {
+            case 'b': printf("%d", v.b); break;
+            case 'B': printf("%u", v.B); break;
+            case 'h': printf("%d", v.h); break;
+            case 'H': printf("%u", v.H); break;
+            case 'i': printf("%ld", (long)v.i); break;
+            case 'I': printf("%lu", (unsigned long)v.I); break;
+            case 'q': printf("%lld", (long long)v.q); break;
+            case 'Q': printf("%llu", (unsigned long long)v.Q); break;
+            case 'f': printf("%.9g", v.f); break;
+            case 'd': printf("%.17g", v.d); break;
+            case 't': {
+                time_t secs = v.I;
+                struct tm tmbuf;
+                char buf[32];
+                strftime(buf, sizeof buf, "%F,%T", gmtime_r(&secs, &tmbuf));
+                printf("%s", buf);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+static void record(uint8_t type, const uint8_t *p, size_t len) {
+    if (BIN_LOG_TYPE_SCHEMA == type) {
+        if (!len) return;
+        schema_t *s = &schemas[p[0]];
+        const char *format = (const char *)p + 1;
+        size_t flen = strnlen(format, len - 1);
+        if (flen == len - 1) return;  // No terminator
+        memcpy(s->format, format, flen + 1);
+        size_t clen = len - 1 - flen - 1;
+        memcpy(s->columns, format + flen + 1, clen);
+        s->columns[clen] = 0;
+        if (only_type == p[0] && !header_printed) {
+            printf("%s\n", s->columns);
+            header_printed = true;
+        } else if (only_type < 0) {
+            printf("type,%s\n", s->columns);
+        }
+        return;
+    }
+    if (only_type >= 0 && type != only_type) return;
+    if (only_type < 0) printf("%u,", type);
+    if (!print_fields(schemas[type].format, p, len)) print_hex(p, len);
+    putchar('\n');
+}
+
+static bool decode(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    uint8_t block[BIN_LOG_BLOCK_SIZE];
+    uint32_t file_id = 0, n;
+    for (n = 0; fread(block, sizeof block, 1, fp) == 1; ++n) {
+        uint16_t used = get16(block + BIN_LOG_HDR_USED);
+        if (get32(block + BIN_LOG_HDR_MAGIC) != BIN_LOG_MAGIC ||
+            get16(block + BIN_LOG_HDR_CRC) !=
+                crc16((const char *)block, BIN_LOG_HDR_CRC) ||
+            get32(block + BIN_LOG_HDR_SEQ) != n ||
+            (n && get32(block + BIN_LOG_HDR_FILE_ID) != file_id) ||
+            used < BIN_LOG_HDR_SIZE || used > BIN_LOG_BLOCK_SIZE)
+            break;  // End of the log
+        if (!n) file_id = get32(block + BIN_LOG_HDR_FILE_ID);
+        for (size_t pos = BIN_LOG_HDR_SIZE;
+             pos + BIN_LOG_REC_OVERHEAD <= used;) {
+            const uint8_t *p = block + pos;
+            size_t len = p[0];
+            if (pos + len + BIN_LOG_REC_OVERHEAD > used ||
+                get16(p + 2 + len) != crc16((const char *)p, len + 2)) {
+                fprintf(stderr, "%s: bad record in block %lu\n", path,
+                        (unsigned long)n);
+                break;
+            }
+            record(p[1], p + 2, len);
+            pos += len + BIN_LOG_REC_OVERHEAD;
+        }
+    }
+    fclose(fp);
+    if (!n) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int i = 1;
+    if (argc > 2 && 0 == strcmp(argv[1], "-t")) {
+        only_type = atoi(argv[2]);
+        i = 3;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: %s [-t <type>] <file>...\n", argv[0]);
+        return 2;
+    }
+    bool ok = true;
+    for (; i < argc; ++i) ok = decode(argv[i]) && ok;
+    return ok ? 0 : 1;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,27 @@
+/* pico/multicore.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Host stand-in: core 1 is a thread, and the inter-core FIFO is a queue of
+// the same depth. Implemented in pico_host.c.
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+void multicore_reset_core1(void);
+void multicore_launch_core1(void (*entry)(void));
+bool multicore_fifo_wready(void);
+void multicore_fifo_push_blocking(uint32_t data);
+uint32_t multicore_fifo_pop_blocking(void);
+
+/* [] END OF FILE */
@@ -0,0 +1,23 @@
+/* pico/mutex.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Host stand-in: only the type, for the headers that mention it
+
+#pragma once
+#include <pthread.h>
+
+typedef struct {
+    pthread_mutex_t m;
+} mutex_t;
+
+/* [] END OF FILE */
@@ -0,0 +1,29 @@
+/* pico/stdlib.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Host stand-in for the parts of the Pico SDK used by the I/O engine and
+// ff_aio, for host tests (see ../aio_host_test.c). Implemented in pico_host.c.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+uint64_t time_us_64(void);
+static inline void tight_loop_contents(void) {}
+
+/* [] END OF FILE */
@@ -0,0 +1,88 @@
+/* pico_host.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Host stand-ins for the Pico SDK functions declared in this directory:
+// core 1 is a POSIX thread, and the inter-core FIFO is a queue of the
+// RP2040's depth, with the same blocking behaviour.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+//
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+#define FIFO_DEPTH 8
+
+static pthread_mutex_t fifo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fifo_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t fifo[FIFO_DEPTH];
+static unsigned fifo_head, fifo_count;
+
+static pthread_t core1_thread;
+static bool core1_started;
+
+uint64_t time_us_64(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *core1_entry(void *arg) {
+    void (*entry)(void) = (void (*)(void))arg;
+    entry();
+    return NULL;
+}
+
+// A thread can't be killed safely, so this waits for the previous entry
+// function to return. (The engine only restarts core 1 after stopping it.)
+void multicore_reset_core1(void) {
+    if (core1_started) pthread_join(core1_thread, NULL);
+    core1_started = false;
+    pthread_mutex_lock(&fifo_mutex);
+    fifo_head = fifo_count = 0;
+    pthread_mutex_unlock(&fifo_mutex);
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    if (pthread_create(&core1_thread, NULL, core1_entry, (void *)entry)) abort();
+    core1_started = true;
+}
+
+bool multicore_fifo_wready(void) {
+    pthread_mutex_lock(&fifo_mutex);
+    bool ready = fifo_count < FIFO_DEPTH;
+    pthread_mutex_unlock(&fifo_mutex);
+    return ready;
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    pthread_mutex_lock(&fifo_mutex);
+    while (FIFO_DEPTH == fifo_count) pthread_cond_wait(&fifo_cond, &fifo_mutex);
+    fifo[(fifo_head + fifo_count++) % FIFO_DEPTH] = data;
+    pthread_cond_broadcast(&fifo_cond);
+    pthread_mutex_unlock(&fifo_mutex);
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    pthread_mutex_lock(&fifo_mutex);
+    while (!fifo_count) pthread_cond_wait(&fifo_cond, &fifo_mutex);
+    uint32_t data = fifo[fifo_head];
+    fifo_head = (fifo_head + 1) % FIFO_DEPTH;
+    --fifo_count;
+    pthread_cond_broadcast(&fifo_cond);
+    pthread_mutex_unlock(&fifo_mutex);
+    return data;
+}
+
+/* [] END OF FILE */
@@ -27,7 +27,21 @@ extern "C" {
                             uint32_t seed);
     void vCreateAndVerifyExampleFiles(const char *pcMountPath);
     void vStdioWithCWDTest(const char *pcMountPath);
+    void start_logger(bool binary);
     bool process_logger();
+    bool stop_logger();
+    void crc_benchmark();
+    void spi_async_test(sd_card_t *pSD);
+    void baud_rate_test(sd_card_t *pSD);
+    void small_file_benchmark(sd_card_t *pSD, const char *dir, size_t count);
+    void dir_lookup_benchmark(const char *dir, size_t max_files);
+    void multicore_stress_test(const char *drive0, const char *drive1, unsigned iterations);
+    void io_engine_test(const char *path, size_t size);
+    void aio_test(const char *dir, unsigned period_us, unsigned samples);
+    void logger_benchmark(const char *dir, unsigned period_us, unsigned seconds);
+    void bin_log_test(const char *path, uint32_t records);
+    void stdio_buffer_benchmark(const char *path, size_t size);
+    void stream_pool_test(const char *dir);
 }
 
 static bool logger_enabled;
@@ -127,8 +141,13 @@ static void run_format() {
         printf("Unknown logical drive number: \"%s\"\n", arg1);
         return;
     }
-    /* Format the drive with default parameters */
-    FRESULT fr = f_mkfs(arg1, 0, 0, FF_MAX_SS * 2);
+    /* Format the drive with default parameters, except maybe alignment.
+       Alignment 0 (default) aligns the data area to the card's allocation
+       unit; e.g., 1 doesn't align it. */
+    MKFS_PARM opt = {FM_ANY, 0, 0, 0, 0};
+    const char *arg2 = strtok(NULL, " ");
+    if (arg2) opt.align = strtoul(arg2, NULL, 0);
+    FRESULT fr = f_mkfs(arg1, &opt, 0, FF_MAX_SS * 2);
     if (FR_OK != fr) printf("f_mkfs error: %s (%d)\n", FRESULT_str(fr), fr);
 }
 static void run_mount() {
@@ -194,6 +213,111 @@ static void run_getfree() {
     printf("%10lu KiB total drive space.\n%10lu KiB available.\n", tot_sect / 2,
            fre_sect / 2);
 }
+static volatile DWORD getfree_done, getfree_total;
+static void getfree_progress(DWORD done, DWORD total) {  // Runs on core 1
+    getfree_done = done;
+    getfree_total = total;
+}
+static void run_getfree_bg() {
+    const char *arg1 = strtok(NULL, " ");
+    if (!arg1) arg1 = sd_get_by_num(0)->pcName;
+    FATFS *p_fs = sd_get_fs_by_name(arg1);
+    if (!p_fs) {
+        printf("Unknown logical drive number: \"%s\"\n", arg1);
+        return;
+    }
+    if (p_fs->fs_type) p_fs->free_clst = 0xFFFFFFFF;  // Force a FAT scan
+    getfree_done = getfree_total = 0;
+    absolute_time_t start = get_absolute_time();
+    if (!f_getfree_start(arg1, getfree_progress)) {
+        printf("Core 1 is in use by %s\n",
+               core1_owner() ? core1_owner() : "something else");
+        return;
+    }
+    // Core 0 is free meanwhile; here, it just reports progress
+    FRESULT fr;
+    DWORD fre_clust;
+    while (!f_getfree_done(&fr, &fre_clust)) {
+        if (getfree_total)
+            printf("\r%3lu%%", (unsigned long)(100ULL * getfree_done / getfree_total));
+        sleep_ms(100);
+    }
+    printf("\rScanned in %lld ms\n",
+           absolute_time_diff_us(start, get_absolute_time()) / 1000);
+    if (FR_OK != fr) {
+        printf("f_getfree error: %s (%d)\n", FRESULT_str(fr), fr);
+        return;
+    }
+    printf("%10lu KiB available.\n", fre_clust * p_fs->csize / 2);
+}
+static void run_sd_stats() {
+    const char *arg1 = strtok(NULL, " ");
+    if (!arg1) arg1 = sd_get_by_num(0)->pcName;
+    sd_card_t *pSD = sd_get_by_name(arg1);
+    if (!pSD) {
+        printf("Unknown logical drive number: \"%s\"\n", arg1);
+        return;
+    }
+    const sd_card_stats_t *s = &pSD->stats;
+    printf("Write-behind: %s\n", pSD->write_behind ? "on" : "off");
+    printf("Writes returned before programming finished: %lu\n",
+           (unsigned long)s->busy_deferred);
+    printf("Time waiting for programming: %llu us\n", s->busy_wait_us);
+    printf("Programming time possibly hidden: up to %llu us\n",
+           s->busy_overlap_us);
+    printf("Write streaming: %s\n", pSD->write_streaming ? "on" : "off");
+    printf("Write streams opened: %lu, continued: %lu\n",
+           (unsigned long)s->streams_opened, (unsigned long)s->stream_writes);
+    printf("Read-ahead: %s\n", pSD->read_ahead ? "on" : "off");
+    printf("Reads: %lu, read streams opened: %lu, hits: %lu, misses: %lu\n",
+           (unsigned long)s->reads, (unsigned long)s->read_streams_opened,
+           (unsigned long)s->read_stream_hits,
+           (unsigned long)s->read_stream_misses);
+    if (s->reads)
+        printf("Read-ahead hit ratio: %.1f%%\n",
+               100.0 * s->read_stream_hits / s->reads);
+    printf("CRC errors: %lu, no response errors: %lu\n",
+           (unsigned long)s->crc_errors, (unsigned long)s->no_response_errors);
+    printf("SPI clock: %u Hz (card maximum %u Hz), steps down: %lu, up: %lu\n",
+           pSD->baud_rate, pSD->max_baud_rate,
+           (unsigned long)s->baud_rate_steps_down,
+           (unsigned long)s->baud_rate_steps_up);
+    printf("Sector cache hits: %lu, misses: %lu, write-backs: %lu, "
+           "discards: %lu\n",
+           (unsigned long)s->cache_hits, (unsigned long)s->cache_misses,
+           (unsigned long)s->cache_write_backs,
+           (unsigned long)s->cache_discards);
+}
+static void run_spi_async_test() {
+    const char *arg1 = strtok(NULL, " ");
+    if (!arg1) arg1 = sd_get_by_num(0)->pcName;
+    sd_card_t *pSD = sd_get_by_name(arg1);
+    if (!pSD) {
+        printf("Unknown logical drive number: \"%s\"\n", arg1);
+        return;
+    }
+    spi_async_test(pSD);
+}
+#ifdef SD_CRC_ERROR_INJECTION
+static void run_inject_crc_errors() {
+    const char *arg1 = strtok(NULL, " ");
+    if (!arg1) {
+        printf("Missing argument\n");
+        return;
+    }
+    set_sd_crc_error_injection(strtoul(arg1, NULL, 0));
+}
+static void run_baud_rate_test() {
+    const char *arg1 = strtok(NULL, " ");
+    if (!arg1) arg1 = sd_get_by_num(0)->pcName;
+    sd_card_t *pSD = sd_get_by_name(arg1);
+    if (!pSD) {
+        printf("Unknown logical drive number: \"%s\"\n", arg1);
+        return;
+    }
+    baud_rate_test(pSD);
+}
+#endif
 static void run_cd() {
     char *arg1 = strtok(NULL, " ");
     if (!arg1) {
@@ -324,6 +448,102 @@ static void run_del_node() {
     }
     del_node(arg1);
 }
+static void run_small_file_benchmark() {
+    const char *dir = strtok(NULL, " ");
+    if (!dir) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcCount = strtok(NULL, " ");
+    size_t count = pcCount ? strtoul(pcCount, 0, 0) : 100;
+    // The card holding the current directory, e.g., "0:/..."
+    char cwdbuf[FF_LFN_BUF] = {0};
+    sd_card_t *pSD = NULL;
+    if (FR_OK == f_getcwd(cwdbuf, sizeof cwdbuf)) {
+        char *colon = strchr(cwdbuf, ':');
+        if (colon) {
+            colon[1] = 0;
+            pSD = sd_get_by_name(cwdbuf);
+        }
+    }
+    small_file_benchmark(pSD, dir, count);
+}
+static void run_dir_lookup_benchmark() {
+    const char *dir = strtok(NULL, " ");
+    if (!dir) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcCount = strtok(NULL, " ");
+    dir_lookup_benchmark(dir, pcCount ? strtoul(pcCount, 0, 0) : 2048);
+}
+static void run_multicore_stress_test() {
+    const char *drive0 = strtok(NULL, " ");
+    const char *drive1 = strtok(NULL, " ");
+    if (!drive0 || !drive1) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcIterations = strtok(NULL, " ");
+    multicore_stress_test(drive0, drive1, pcIterations ? strtoul(pcIterations, 0, 0) : 200);
+}
+static void run_io_engine_test() {
+    const char *path = strtok(NULL, " ");
+    if (!path) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcSize = strtok(NULL, " ");
+    io_engine_test(path, pcSize ? strtoul(pcSize, 0, 0) : 1024 * 1024);
+}
+static void run_aio_test() {
+    const char *dir = strtok(NULL, " ");
+    if (!dir) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcPeriod = strtok(NULL, " ");
+    const char *pcSamples = strtok(NULL, " ");
+    aio_test(dir, pcPeriod ? strtoul(pcPeriod, 0, 0) : 100,
+             pcSamples ? strtoul(pcSamples, 0, 0) : 100000);
+}
+static void run_logger_benchmark() {
+    const char *dir = strtok(NULL, " ");
+    if (!dir) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcPeriod = strtok(NULL, " ");
+    const char *pcSeconds = strtok(NULL, " ");
+    logger_benchmark(dir, pcPeriod ? strtoul(pcPeriod, 0, 0) : 50,
+                     pcSeconds ? strtoul(pcSeconds, 0, 0) : 10);
+}
+static void run_bin_log_test() {
+    const char *path = strtok(NULL, " ");
+    if (!path) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcRecords = strtok(NULL, " ");
+    bin_log_test(path, pcRecords ? strtoul(pcRecords, 0, 0) : 100000);
+}
+static void run_stdio_buffer_benchmark() {
+    const char *path = strtok(NULL, " ");
+    if (!path) {
+        printf("Missing argument\n");
+        return;
+    }
+    const char *pcSize = strtok(NULL, " ");
+    stdio_buffer_benchmark(path, pcSize ? strtoul(pcSize, 0, 0) : 256 * 1024);
+}
+static void run_stream_pool_test() {
+    const char *dir = strtok(NULL, " ");
+    if (!dir) {
+        printf("Missing argument\n");
+        return;
+    }
+    stream_pool_test(dir);
+}
 static void run_cdef() {
     f_mkdir("/cdef");  // fake mountpoint
     vCreateAndVerifyExampleFiles("/cdef");
@@ -339,10 +559,15 @@ static void run_loop_swcwdt() {
     } while (PICO_ERROR_TIMEOUT == cRxedChar);
 }
 static void run_start_logger() {
+    const char *arg = strtok(NULL, " ");
+    start_logger(arg && 0 == strcmp(arg, "bin"));
     logger_enabled = true;
     next_log_time = delayed_by_ms(get_absolute_time(), period);
 }
-static void run_stop_logger() { logger_enabled = false; }
+static void run_stop_logger() {
+    logger_enabled = false;
+    stop_logger();
+}
 static void run_help();
 
 typedef void (*p_fn_t)();
@@ -364,8 +589,10 @@ static cmd_def_t cmds[] = {
      "lliot <drive#>:\n !DESTRUCTIVE! Low Level I/O Driver Test\n"
      "\te.g.: lliot 1"},
     {"format", run_format,
-     "format [<drive#:>]:\n"
+     "format [<drive#:>] [<align>]:\n"
      "  Creates an FAT/exFAT volume on the logical drive.\n"
+     "  <align> Data area alignment in sectors. Default: the card's\n"
+     "   allocation unit size.\n"
      "\te.g.: format 0:"},
     {"mount", run_mount,
      "mount [<drive#:>]:\n"
@@ -382,6 +609,21 @@ static cmd_def_t cmds[] = {
     {"getfree", run_getfree,
      "getfree [<drive#:>]:\n"
      "  Print the free space on drive"},
+    {"getfree_bg", run_getfree_bg,
+     "getfree_bg [<drive#:>]:\n"
+     "  Count the free space on drive with a full FAT scan, on core 1"},
+    {"sd_stats", run_sd_stats,
+     "sd_stats [<drive#:>]:\n"
+     "  Print SD card driver performance counters"},
+#ifdef SD_CRC_ERROR_INJECTION
+    {"inject_crc_errors", run_inject_crc_errors,
+     "inject_crc_errors <N>:\n"
+     "  For testing: corrupt the CRC of one in N received blocks (0: off)"},
+    {"baud_rate_test", run_baud_rate_test,
+     "baud_rate_test [<drive#:>]:\n"
+     "  Inject CRC errors until the SPI clock steps down, then read until it\n"
+     "  is back up, checking the error counts and clock steps"},
+#endif
     {"cd", run_cd,
      "cd <path>:\n"
      "  Changes the current directory of the logical drive.\n"
@@ -406,6 +648,61 @@ static cmd_def_t cmds[] = {
      " <size in bytes> must be multiple of 512.\n"
      "\te.g.: big_file_test bf 1048576 1\n"
      "\tor: big_file_test big3G-3 0xC0000000 3"},
+    {"crc_benchmark", crc_benchmark,
+     "crc_benchmark:\n"
+     "  Compare the CRC implementations and measure their speed"},
+    {"spi_async_test", run_spi_async_test,
+     "spi_async_test [<drive#:>]:\n"
+     "  Queue asynchronous SPI transfers with callbacks on the drive's SPI,\n"
+     "  with the card deselected, and check their order and completion"},
+    {"small_file_benchmark", run_small_file_benchmark,
+     "small_file_benchmark <dir> [<count>]:\n"
+     "  Create and then delete <count> (default 100) small files in <dir>,\n"
+     "  reporting the time per file and the sector cache counters\n"
+     "\te.g.: small_file_benchmark sfb 200"},
+    {"dir_lookup_benchmark", run_dir_lookup_benchmark,
+     "dir_lookup_benchmark <dir> [<max files>]:\n"
+     "  Time f_stat in <dir> as it fills up with files, doubling from 64\n"
+     "  to <max files> (default 2048)\n"
+     "\te.g.: dir_lookup_benchmark dlb 4096"},
+    {"multicore_stress_test", run_multicore_stress_test,
+     "multicore_stress_test <drive#:> <drive#:> [<iterations>]:\n"
+     "  Write, check and delete files on the first drive from core 0 and on\n"
+     "  the second from core 1, at the same time. The drives can be the same.\n"
+     "  Uses core 1, so it won't run during getfree_bg or while the I/O engine runs.\n"
+     "\te.g.: multicore_stress_test 0: 1: 500"},
+    {"io_engine_test", run_io_engine_test,
+     "io_engine_test <pathname> [<size in bytes>]:\n"
+     "  Write and read back a file (default 1 MiB) through the core 1 I/O\n"
+     "  engine, reporting core 0's longest loop time and the queue statistics\n"
+     "\te.g.: io_engine_test ioe 4194304"},
+    {"aio_test", run_aio_test,
+     "aio_test <dir> [<period us> [<samples>]]:\n"
+     "  Log two simulated sensors, sampled every <period us> (default 100),\n"
+     "  to files in <dir> with ff_aio_write, then check the files\n"
+     "\te.g.: aio_test aio 50 200000"},
+    {"logger_benchmark", run_logger_benchmark,
+     "logger_benchmark <dir> [<period us> [<seconds>]]:\n"
+     "  Log a record every <period us> (default 50) from a timer interrupt\n"
+     "  for <seconds> (default 10) with the data logger, writing to files\n"
+     "  in <dir>, and report the record rate and any records dropped\n"
+     "\te.g.: logger_benchmark lb 20 30"},
+    {"bin_log_test", run_bin_log_test,
+     "bin_log_test <pathname> [<records>]:\n"
+     "  Write <records> (default 100000) to a binary log, cut it off as a\n"
+     "  power failure would, recover, carry on, and check the log\n"
+     "\te.g.: bin_log_test bl.bin 200000"},
+    {"stdio_buffer_benchmark", run_stdio_buffer_benchmark,
+     "stdio_buffer_benchmark <pathname> [<size in bytes>]:\n"
+     "  Time ff_fputc, ff_fgetc and ff_fgets on a file (default 256 KiB)\n"
+     "  with each ff_setvbuf buffering mode\n"
+     "\te.g.: stdio_buffer_benchmark sbb.txt 1048576"},
+    {"stream_pool_test", run_stream_pool_test,
+     "stream_pool_test <directory>:\n"
+     "  Open more ff_stdio streams at once than are pooled, time ff_fopen\n"
+     "  and ff_fclose, and print the usage of the stream and LFN buffer\n"
+     "  pools\n"
+     "\te.g.: stream_pool_test /"},
     {"cdef", run_cdef,
      "cdef:\n  Create Disk and Example Files\n"
      "  Expects card to be already formatted and mounted"},
@@ -419,8 +716,8 @@ static cmd_def_t cmds[] = {
      "Expects card to be already formatted and mounted.\n"
      "Note: Type any key to quit."},
     {"start_logger", run_start_logger,
-     "start_logger:\n"
-     "  Start Data Log Demo"},
+     "start_logger [bin]:\n"
+     "  Start Data Log Demo, logging in CSV or, with bin, binary"},
     {"stop_logger", run_stop_logger,
      "stop_logger:\n"
      "  Stop Data Log Demo"},
@@ -13,46 +13,52 @@ specific language governing permissions and limitations under the License.
 */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <time.h>
 //
 #include "hardware/adc.h"
 #include "pico/stdlib.h"
 //
-#include "ff.h"
-//
+#include "bin_log.h"
+#include "data_logger.h"
 #include "f_util.h"
 #include "my_debug.h"
 
-#define DEVICENAME "0:"
-
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf
 
-static bool print_header(FIL *fp) {
-    TRACE_PRINTF("%s\n", __func__);
-    myASSERT(fp);
-    FRESULT fr = f_lseek(fp, f_size(fp));
-    if (FR_OK != fr) {
-        printf("f_lseek error: %s (%d)\n", FRESULT_str(fr), fr);
-        return false;
-    }
-    if (0 == f_tell(fp)) {
-        // Print header
-        if (f_printf(fp, "Date,Time,Temperature (°C)\n") < 0) {
-            printf("f_printf error\n");
-            return false;
-        }
-    }
-    return true;
-}
+// CSV: records go to a RAM buffer, which data_logger_task writes to the
+// current hour's file (/data/YYYY-MM-DD/HH.csv) a batch at a time,
+// calling f_sync (http://elm-chan.org/fsw/ff/doc/sync.html) every
+// sync_period_ms.
+static uint8_t log_buf[8 * 1024];
+static data_logger_t logger = {
+    .dir = "/data",
+    .suffix = ".csv",
+    .header = "Date,Time,Temperature (°C)\n",
+    .buf = log_buf,
+    .buf_size = sizeof log_buf,
+    .batch_size = 0,        // Default
+    .sync_period_ms = 1000  // Lose at most a second or so on power failure
+};
+static bool logger_initialized;
 
-static bool open_file(FIL *fp) {
-    TRACE_PRINTF("%s\n", __func__);
-    myASSERT(fp);
-    const time_t timer = time(NULL);
-    struct tm tmbuf;
-    localtime_r(&timer, &tmbuf);
+// Binary: 12 byte records in /data/YYYY-MM-DD/HH.bin (see bin_log.h),
+// preallocated for an hour's worth. Convert with tools/bin_log_decode.
+#define TYPE_TEMPERATURE 1
+#define BIN_SYNC_PERIOD_S 10
+typedef struct __attribute__((packed)) {
+    uint32_t time;  // Seconds since 1970
+    float temperature;
+} temperature_record_t;
+static bin_log_t bin_log;
+static bool bin_log_is_open;
+static int bin_log_hour;
+static time_t last_sync;
+static bool binary;
+
+static bool open_bin_log(const struct tm *ptm) {
     char filename[64];
     int n = snprintf(filename, sizeof filename, "/data");
     myASSERT(0 < n && n < (int)sizeof filename);
@@ -61,44 +67,82 @@ static bool open_file(FIL *fp) {
         printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
         return false;
     }
-    //  tm_year	int	years since 1900
-    //  tm_mon	int	months since January	0-11
-    //  tm_mday	int	day of the month	1-31
-    n += snprintf(filename + n, sizeof filename - n, "/%04d-%02d-%02d",
-                  tmbuf.tm_year + 1900, tmbuf.tm_mon + 1, tmbuf.tm_mday);
-    myASSERT(0 < n && n < (int)sizeof filename);
+    n += strftime(filename + n, sizeof filename - n, "/%F", ptm);
     fr = f_mkdir(filename);
     if (FR_OK != fr && FR_EXIST != fr) {
         printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
         return false;
     }
-    size_t nw = strftime(filename + n, sizeof filename - n, "/%H.csv", &tmbuf);
+    size_t nw = strftime(filename + n, sizeof filename - n, "/%H.bin", ptm);
     myASSERT(nw);
-    fr = f_open(fp, filename, FA_OPEN_APPEND | FA_WRITE);
-    if (FR_OK != fr && FR_EXIST != fr) {
-        printf("f_open(%s) error: %s (%d)\n", filename, FRESULT_str(fr), fr);
+    fr = bin_log_open(&bin_log, filename,
+                      3600 * (sizeof(temperature_record_t) + BIN_LOG_REC_OVERHEAD));
+    if (FR_OK == fr)
+        fr = bin_log_define(&bin_log, TYPE_TEMPERATURE, "tf",
+                            "Date,Time,Temperature (°C)");
+    if (FR_OK != fr) {
+        printf("bin_log_open(%s) error: %s (%d)\n", filename, FRESULT_str(fr), fr);
         return false;
     }
-    if (!print_header(fp)) return false;
+    bin_log_is_open = true;
+    bin_log_hour = ptm->tm_hour;
     return true;
 }
 
-bool process_logger() {
-    TRACE_PRINTF("%s\n", __func__);
-    /* It's very inefficient to open and close the file for every record,
-    but you're less likely to lose data that way.  But also see f_sync
-    (http://elm-chan.org/fsw/ff/doc/sync.html). */
-    FIL fil;
-    bool rc = open_file(&fil);
-    if (!rc) return false;
+static bool close_bin_log() {
+    if (!bin_log_is_open) return true;
+    bin_log_is_open = false;
+    FRESULT fr = bin_log_close(&bin_log);
+    if (FR_OK != fr) {
+        printf("bin_log_close error: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+    return true;
+}
 
+static bool log_binary(time_t secs, const struct tm *ptm, float Tc) {
+    if (bin_log_is_open && ptm->tm_hour != bin_log_hour && !close_bin_log())
+        return false;
+    if (!bin_log_is_open && !open_bin_log(ptm)) return false;
+    temperature_record_t rec = {.time = secs, .temperature = Tc};
+    FRESULT fr = bin_log_append(&bin_log, TYPE_TEMPERATURE, &rec, sizeof rec);
+    if (FR_OK == fr && secs - last_sync >= BIN_SYNC_PERIOD_S) {
+        fr = bin_log_sync(&bin_log);
+        last_sync = secs;
+    }
+    if (FR_OK != fr) {
+        printf("bin_log error: %s (%d)\n", FRESULT_str(fr), fr);
+        close_bin_log();
+        return false;
+    }
+    return true;
+}
+
+static bool log_csv(const struct tm *ptm, float Tc) {
+    if (!logger_initialized) {
+        if (!data_logger_init(&logger)) return false;
+        logger_initialized = true;
+    }
     // Form date-time string
-    char buf[128];
+    char buf[DATA_LOGGER_MAX_RECORD];
+    size_t n = strftime(buf, sizeof buf, "%F,%T,", ptm);
+    myASSERT(n);
+    int nw = snprintf(buf + n, sizeof buf - n, "%.3g\n", (double)Tc);
+    myASSERT(0 < nw && nw < (int)sizeof buf);
+
+    if (!data_logger_write(&logger, buf, n + nw)) {
+        printf("Log buffer full; record dropped\n");
+    }
+    return data_logger_task(&logger);
+}
+
+void start_logger(bool bin) { binary = bin; }
+
+bool process_logger() {
+    TRACE_PRINTF("%s\n", __func__);
     const time_t secs = time(NULL);
     struct tm tmbuf;
     struct tm *ptm = localtime_r(&secs, &tmbuf);
-    size_t n = strftime(buf, sizeof buf, "%F,%T,", ptm);
-    myASSERT(n);
 
     // The temperature sensor is on input 4:
     adc_select_input(4);
@@ -112,17 +156,14 @@ bool process_logger() {
     //    T = 27 - (ADC_Voltage - 0.706)/0.001721
     float Tc = 27.0f - (voltage - 0.706f) / 0.001721f;
     TRACE_PRINTF("Temperature: %.1f °C\n", (double)Tc);
-    int nw = snprintf(buf + n, sizeof buf - n, "%.3g\n", (double)Tc);
-    myASSERT(0 < nw && nw < (int)sizeof buf);
 
-    if (f_printf(&fil, "%s", buf) < 0) {
-        printf("f_printf failed\n");
-        return false;
-    }
-    FRESULT fr = f_close(&fil);
-    if (FR_OK != fr) {
-        printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
-        return false;
-    }
-    return true;
+    return binary ? log_binary(secs, ptm, Tc) : log_csv(ptm, Tc);
+}
+
+// Write out whatever is buffered and close the file
+bool stop_logger() {
+    TRACE_PRINTF("%s\n", __func__);
+    bool ok = close_bin_log();
+    if (logger_initialized) ok = data_logger_close(&logger) && ok;
+    return ok;
 }
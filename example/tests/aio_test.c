@@ -0,0 +1,182 @@
+/* aio_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// A superloop that samples two "sensors" on a fixed schedule and logs each
+// to its own file with ff_aio_write, double buffered, so that sampling
+// carries on while the card programs. Reports how late any sample was taken
+// and how many buffers had to be dropped, then reads the files back and
+// checks them.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff_aio.h"
+#include "ff_stdio.h"
+
+#define CHANNELS 2
+#define BUF_SAMPLES 1024  // 4 KiB buffers
+
+typedef struct {
+    FF_FILE *file;
+    uint32_t bufs[2][BUF_SAMPLES];
+    ff_aiocb_t cbs[2];
+    unsigned active;  // Buffer being filled: its control block is free
+    size_t fill;      // Samples in it
+    uint32_t next;    // Next sample value
+    unsigned dropped;
+    bool failed;
+} channel_t;
+
+static channel_t channels[CHANNELS];
+
+// A sample: the channel's count, so that the files can be checked
+static uint32_t sample(channel_t *ch) { return ch->next++; }
+
+static void flush_buffer(channel_t *ch) {
+    ff_aiocb_t *cb = &ch->cbs[ch->active];
+    if (ff_aio_write(ch->file, ch->bufs[ch->active], ch->fill * sizeof(uint32_t), cb)) {
+        printf("ff_aio_write error: %s (%d)\n", strerror(errno), errno);
+        ch->failed = true;
+    }
+    ch->active ^= 1;
+    ch->fill = 0;
+}
+
+// Check a finished write
+static void check_write(channel_t *ch, unsigned i) {
+    ff_aiocb_t *cb = &ch->cbs[i];
+    int error = ff_aio_error(cb);
+    if (EINPROGRESS == error || !cb->len) return;
+    if (error || (size_t)ff_aio_return(cb) != cb->len) {
+        printf("Write error: %s (%d)\n", strerror(error), error);
+        ch->failed = true;
+    }
+    cb->len = 0;
+}
+
+static bool check_file(const char *path, unsigned dropped) {
+    FF_FILE *file = ff_fopen(path, "r");
+    if (!file) {
+        printf("ff_fopen(%s) error: %s (%d)\n", path, strerror(errno), errno);
+        return false;
+    }
+    static uint32_t buf[BUF_SAMPLES];
+    uint32_t expect = 0;
+    unsigned gaps = 0;
+    size_t n;
+    while ((n = ff_fread(buf, sizeof(uint32_t), BUF_SAMPLES, file)) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            if (buf[i] != expect) {
+                if (buf[i] < expect || (buf[i] - expect) % BUF_SAMPLES) {
+                    printf("%s: bad sample %lu, expected %lu\n", path,
+                           (unsigned long)buf[i], (unsigned long)expect);
+                    ff_fclose(file);
+                    return false;
+                }
+                gaps += (buf[i] - expect) / BUF_SAMPLES;  // Dropped buffers
+            }
+            expect = buf[i] + 1;
+        }
+    }
+    ff_fclose(file);
+    if (gaps != dropped) {
+        printf("%s: %u buffers missing, but %u dropped\n", path, gaps, dropped);
+        return false;
+    }
+    return true;
+}
+
+void aio_test(const char *dir, unsigned period_us, unsigned samples) {
+    char paths[CHANNELS][64];
+    FRESULT fr = f_mkdir(dir);
+    if (FR_OK != fr && FR_EXIST != fr) {
+        printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return;
+    }
+    memset(channels, 0, sizeof channels);
+    for (unsigned c = 0; c < CHANNELS; ++c) {
+        snprintf(paths[c], sizeof paths[c], "%s/sensor%u.bin", dir, c);
+        channels[c].file = ff_fopen(paths[c], "w");
+        if (!channels[c].file) {
+            printf("ff_fopen(%s) error: %s (%d)\n", paths[c], strerror(errno), errno);
+            while (c--) ff_fclose(channels[c].file);
+            return;
+        }
+    }
+    io_engine_reset_stats();
+    uint32_t max_late_us = 0;
+    uint64_t start = time_us_64();
+    for (unsigned s = 0; s < samples; ++s) {
+        // Sample on schedule
+        uint64_t due = start + (uint64_t)s * period_us;
+        uint64_t now;
+        while ((now = time_us_64()) < due) {
+            // Meanwhile, collect finished writes
+            for (unsigned c = 0; c < CHANNELS; ++c)
+                for (unsigned i = 0; i < 2; ++i) check_write(&channels[c], i);
+        }
+        if (now - due > max_late_us) max_late_us = now - due;
+        for (unsigned c = 0; c < CHANNELS; ++c) {
+            channel_t *ch = &channels[c];
+            ch->bufs[ch->active][ch->fill++] = sample(ch);
+            if (BUF_SAMPLES == ch->fill) {
+                check_write(ch, ch->active ^ 1);
+                if (ch->cbs[ch->active ^ 1].len) {
+                    // Card fell behind: the other buffer is still being written
+                    ++ch->dropped;
+                    ch->fill = 0;
+                } else {
+                    flush_buffer(ch);
+                }
+            }
+        }
+    }
+    // Write what's left, and sync
+    ff_aiocb_t sync_cbs[CHANNELS];
+    ff_aiocb_t *list[CHANNELS];
+    for (unsigned c = 0; c < CHANNELS; ++c) {
+        channel_t *ch = &channels[c];
+        if (ch->fill) flush_buffer(ch);
+        ff_aio_fsync(ch->file, &sync_cbs[c]);
+        list[c] = &sync_cbs[c];
+    }
+    for (unsigned c = 0; c < CHANNELS; ++c) {
+        // Requests finish in order, so the writes are done when the sync is
+        while (EINPROGRESS == ff_aio_error(list[c])) ff_aio_suspend(&list[c], 1, 0);
+        for (unsigned i = 0; i < 2; ++i) check_write(&channels[c], i);
+        if (ff_aio_error(list[c])) channels[c].failed = true;
+    }
+    uint64_t elapsed_us = time_us_64() - start;
+    io_engine_stop();  // Release core 1
+
+    io_engine_stats_t st;
+    io_engine_get_stats(&st);
+    printf("%u samples x %u channels every %u us in %llu ms; latest sample %lu us late\n",
+           samples, CHANNELS, period_us, elapsed_us / 1000, (unsigned long)max_late_us);
+    printf("Writes: %lu, max in flight %lu, max service %lu us\n",
+           (unsigned long)st.completed, (unsigned long)st.max_depth,
+           (unsigned long)st.max_service_us);
+    bool ok = true;
+    for (unsigned c = 0; c < CHANNELS; ++c) {
+        ff_fclose(channels[c].file);
+        printf("%s: %u buffers dropped\n", paths[c], channels[c].dropped);
+        ok = ok && !channels[c].failed && check_file(paths[c], channels[c].dropped);
+    }
+    printf("%s\n", ok ? "Files checked" : "FAILED");
+}
+
+/* [] END OF FILE */
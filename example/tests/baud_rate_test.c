@@ -0,0 +1,127 @@
+/* baud_rate_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Check the adaptive SPI clock: with a CRC error injected into every block
+// received, reads must fail with CRC errors (not "no response"), every
+// attempt must be counted, and the clock must step down; with the
+// injection off, it must step back up to where it started, and the error
+// counts must stay put.
+// Needs SD_CRC_ERROR_INJECTION (see example/CMakeLists.txt).
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "sd_card.h"
+
+#ifdef SD_CRC_ERROR_INJECTION
+
+#define MAX_FAILING_READS 20
+#define MAX_CLEAN_READS 100000
+
+static uint8_t buf[512];
+
+#define FAIL(fmt, args...)                   \
+    {                                        \
+        printf("FAILED: " fmt "\n", ##args); \
+        return false;                        \
+    }
+
+static bool run(sd_card_t *pSD) {
+    const sd_card_stats_t *s = &pSD->stats;
+    const uint start_rate = pSD->baud_rate;
+    const uint32_t no_response_errors = s->no_response_errors;
+
+    // Every read fails, each attempt with a CRC error. Go on until the
+    // clock has stepped down, and then once more.
+    set_sd_crc_error_injection(1);
+    uint32_t attempts = 0;  // CRC errors per failed read
+    int extra = -1;
+    for (size_t i = 0; i < MAX_FAILING_READS && extra < 1; ++i) {
+        uint32_t crc_errors = s->crc_errors;
+        uint32_t steps_down = s->baud_rate_steps_down;
+        uint rate = pSD->baud_rate;
+        int status = pSD->read_blocks(pSD, buf, 0, 1);
+        if (SD_BLOCK_DEVICE_ERROR_CRC != status)
+            FAIL("Read %zu returned %d; expected a CRC error", i, status);
+        uint32_t n = s->crc_errors - crc_errors;
+        if (!n) FAIL("Read %zu: CRC error not counted", i);
+        if (!attempts) attempts = n;
+        if (n != attempts)
+            FAIL("Read %zu: %lu CRC errors counted; expected %lu", i,
+                 (unsigned long)n, (unsigned long)attempts);
+        if (s->no_response_errors != no_response_errors)
+            FAIL("Read %zu: counted as no response", i);
+        uint32_t steps = s->baud_rate_steps_down - steps_down;
+        if (steps && pSD->baud_rate >= rate)
+            FAIL("Read %zu: stepped down %lu times, but the clock went from "
+                 "%u to %u Hz", i, (unsigned long)steps, rate, pSD->baud_rate);
+        if (!steps && pSD->baud_rate != rate)
+            FAIL("Read %zu: clock changed from %u to %u Hz without a step", i,
+                 rate, pSD->baud_rate);
+        if (pSD->baud_rate < start_rate) ++extra;
+    }
+    set_sd_crc_error_injection(0);
+    if (pSD->baud_rate >= start_rate)
+        FAIL("Clock didn't step down: %u Hz", pSD->baud_rate);
+    printf("%lu CRC errors per failed read; clock stepped down from %u to "
+           "%u Hz\n", (unsigned long)attempts, start_rate, pSD->baud_rate);
+
+    // Clean reads: the clock must probe back up, one step at a time
+    const uint32_t crc_errors = s->crc_errors;
+    const uint ceiling = pSD->spi->baud_rate < pSD->max_baud_rate
+                             ? pSD->spi->baud_rate
+                             : pSD->max_baud_rate;
+    uint64_t start = time_us_64();
+    size_t i;
+    for (i = 0; i < MAX_CLEAN_READS && pSD->baud_rate < start_rate; ++i) {
+        uint32_t steps_up = s->baud_rate_steps_up;
+        uint rate = pSD->baud_rate;
+        int status = pSD->read_blocks(pSD, buf, 0, 1);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+            FAIL("Clean read %zu returned %d", i, status);
+        uint32_t steps = s->baud_rate_steps_up - steps_up;
+        if (steps > 1) FAIL("Clean read %zu: %lu steps up", i, (unsigned long)steps);
+        if (steps && pSD->baud_rate <= rate)
+            FAIL("Clean read %zu: stepped up, but the clock went from %u to "
+                 "%u Hz", i, rate, pSD->baud_rate);
+        if (!steps && pSD->baud_rate != rate)
+            FAIL("Clean read %zu: clock changed from %u to %u Hz without a "
+                 "step", i, rate, pSD->baud_rate);
+        if (pSD->baud_rate > ceiling)
+            FAIL("Clean read %zu: clock %u Hz is over the ceiling of %u Hz", i,
+                 pSD->baud_rate, ceiling);
+    }
+    if (pSD->baud_rate < start_rate)
+        FAIL("Clock only got back up to %u Hz in %zu reads", pSD->baud_rate, i);
+    if (s->crc_errors != crc_errors || s->no_response_errors != no_response_errors)
+        FAIL("Errors counted in clean reads");
+    printf("Back up to %u Hz after %zu clean reads (%llu ms)\n",
+           pSD->baud_rate, i, (time_us_64() - start) / 1000);
+    return true;
+}
+
+void baud_rate_test(sd_card_t *pSD) {
+    if (!pSD->baud_rate) {
+        printf("SPI clock not negotiated; mount the drive first\n");
+        return;
+    }
+    bool ok = run(pSD);
+    set_sd_crc_error_injection(0);
+    if (ok) printf("OK\n");
+}
+
+#endif
+
+/* [] END OF FILE */
@@ -24,6 +24,7 @@ specific language governing permissions and limitations under the License.
 //
 //#include "ff_headers.h"
 #include "ff_stdio.h"
+#include "sd_card.h"
 
 #define FF_MAX_SS 512
 #define BUFFSZ 8 * 1024
@@ -125,9 +126,9 @@ static bool create_big_file(const char *const pathname, size_t size,
 }
 
 // Read a file of size "size" bytes filled with random data seeded with "seed"
-// and verify the data
-static void check_big_file(const char *const pathname, size_t size,
-                           uint32_t seed) {
+// and verify the data. Returns the transfer rate in KiB/s.
+static double check_big_file(const char *const pathname, size_t size,
+                             uint32_t seed) {
     int32_t lItems;
     FF_FILE *pxFile;
 
@@ -173,7 +174,9 @@ static void check_big_file(const char *const pathname, size_t size,
     int64_t elapsed_us = absolute_time_diff_us(xStart, get_absolute_time());
     float elapsed = elapsed_us / 1E6;
     printf("Elapsed seconds %.3g\n", elapsed);
-    printf("Transfer rate %.3g KiB/s\n", (double)size / elapsed / 1024);
+    double rate = (double)size / elapsed / 1024;
+    printf("Transfer rate %.3g KiB/s\n", rate);
+    return rate;
 }
 
 // Create a file of size "size" bytes filled with random data seeded with "seed"
@@ -257,8 +260,18 @@ void check_big_file_v1(const char *const pathname, size_t size, uint32_t seed) {
 }
 
 void big_file_test(const char *const pathname, size_t size, uint32_t seed) {
-    if (create_big_file(pathname, size, seed)) 
-        check_big_file(pathname, size, seed);
+    if (!create_big_file(pathname, size, seed))
+        return;
+    // For comparison, read (up to) the first 16 MiB without read pipelining
+    size_t cmp_size = size < 16 * 1024 * 1024 ? size : 16 * 1024 * 1024;
+    printf("Without read pipelining:\n");
+    bool was_pipelining = set_sd_read_pipelining(false);
+    double base_rate = check_big_file(pathname, cmp_size, seed);
+    set_sd_read_pipelining(true);
+    printf("With read pipelining:\n");
+    double rate = check_big_file(pathname, size, seed);
+    set_sd_read_pipelining(was_pipelining);
+    printf("Read pipelining gain: %.1f%%\n", (rate / base_rate - 1) * 100);
 }
 
 /* [] END OF FILE */
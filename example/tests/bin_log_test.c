@@ -0,0 +1,176 @@
+/* bin_log_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Exercise the binary log: append records to a preallocated log, "lose
+// power" without writing the last partial block, recover, check that
+// exactly the records that had reached the card are found, carry on
+// logging, and read the whole log back.
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "bin_log.h"
+#include "crc.h"
+#include "f_util.h"
+
+#define TYPE_SEQUENCE 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t time;
+} rec_t;
+
+static bin_log_t test_log;
+static uint8_t block[BIN_LOG_BLOCK_SIZE];
+
+#define FAIL(fmt, args...)                   \
+    {                                        \
+        printf("FAILED: " fmt "\n", ##args); \
+        return false;                        \
+    }
+
+static bool append(uint32_t from, uint32_t to) {
+    uint64_t start = time_us_64();
+    for (uint32_t i = from; i < to; ++i) {
+        rec_t rec = {i, time_us_32()};
+        FRESULT fr = bin_log_append(&test_log, TYPE_SEQUENCE, &rec, sizeof rec);
+        if (FR_OK != fr) FAIL("bin_log_append: %s (%d)", FRESULT_str(fr), fr);
+    }
+    uint64_t elapsed = time_us_64() - start + 1;
+    printf("Appended %lu records in %llu us (%.0f/s)\n",
+           (unsigned long)(to - from), (unsigned long long)elapsed,
+           (to - from) * 1E6 / elapsed);
+    return true;
+}
+
+// Read the log from the start; count the TYPE_SEQUENCE records, checking
+// that they are in sequence
+static bool read_back(const char *path, uint32_t *count) {
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_READ);
+    if (FR_OK != fr) FAIL("f_open: %s (%d)", FRESULT_str(fr), fr);
+    *count = 0;
+    UINT br;
+    uint32_t file_id = 0;
+    for (uint32_t n = 0;; ++n) {
+        fr = f_read(&fil, block, sizeof block, &br);
+        if (FR_OK != fr) FAIL("f_read: %s (%d)", FRESULT_str(fr), fr);
+        if (br < sizeof block) break;
+        uint32_t seq, id;
+        memcpy(&seq, block + BIN_LOG_HDR_SEQ, sizeof seq);
+        memcpy(&id, block + BIN_LOG_HDR_FILE_ID, sizeof id);
+        if (!n) file_id = id;
+        if (seq != n || id != file_id) break;  // Preallocated space
+        uint16_t used;
+        memcpy(&used, block + BIN_LOG_HDR_USED, sizeof used);
+        for (uint16_t pos = BIN_LOG_HDR_SIZE; pos < used;) {
+            uint8_t *p = block + pos;
+            uint16_t crc;
+            memcpy(&crc, p + 2 + p[0], sizeof crc);
+            if (crc != crc16((const char *)p, p[0] + 2))
+                FAIL("Bad record in block %lu", (unsigned long)n);
+            if (TYPE_SEQUENCE == p[1]) {
+                rec_t rec;
+                memcpy(&rec, p + 2, sizeof rec);
+                if (rec.seq != *count)
+                    FAIL("Record %lu out of sequence: %lu",
+                         (unsigned long)*count, (unsigned long)rec.seq);
+                ++*count;
+            }
+            pos += p[0] + BIN_LOG_REC_OVERHEAD;
+        }
+    }
+    f_close(&fil);
+    return true;
+}
+
+static bool run(const char *path, uint32_t records) {
+    FRESULT fr = f_unlink(path);
+    if (FR_OK != fr && FR_NO_FILE != fr)
+        FAIL("f_unlink: %s (%d)", FRESULT_str(fr), fr);
+    // Room for twice as many records as the first pass writes
+    FSIZE_t prealloc = 2 * records * (sizeof(rec_t) + BIN_LOG_REC_OVERHEAD);
+    fr = bin_log_open(&test_log, path, prealloc);
+    if (FR_OK == fr)
+        fr = bin_log_define(&test_log, TYPE_SEQUENCE, "II", "Sequence,Microseconds");
+    if (FR_OK != fr) FAIL("bin_log_open: %s (%d)", FRESULT_str(fr), fr);
+
+    if (!append(0, records / 2)) return false;
+    fr = bin_log_sync(&test_log);
+    if (FR_OK != fr) FAIL("bin_log_sync: %s (%d)", FRESULT_str(fr), fr);
+    uint32_t synced_seq = test_log.seq;
+    uint16_t synced_used = test_log.used;
+    if (!append(records / 2, records)) return false;
+
+    // Power failure: what was added to the partial block in RAM since it
+    // was last written is lost
+    uint32_t expected = records;
+    if (test_log.dirty) {
+        uint16_t pos = test_log.seq == synced_seq ? synced_used : BIN_LOG_HDR_SIZE;
+        while (pos < test_log.used) {
+            const uint8_t *p = test_log.block + pos;
+            if (TYPE_SEQUENCE == p[1]) --expected;
+            pos += p[0] + BIN_LOG_REC_OVERHEAD;
+        }
+    }
+    fr = f_close(&test_log.file);
+    if (FR_OK != fr) FAIL("f_close: %s (%d)", FRESULT_str(fr), fr);
+
+    FIL fil;
+    fr = f_open(&fil, path, FA_READ);
+    if (FR_OK != fr) FAIL("f_open: %s (%d)", FRESULT_str(fr), fr);
+    bin_log_end_t end;
+    uint64_t start = time_us_64();
+    fr = bin_log_recover(&fil, block, &end);
+    uint64_t elapsed = time_us_64() - start;
+    FSIZE_t size = f_size(&fil);
+    f_close(&fil);
+    if (FR_OK != fr) FAIL("bin_log_recover: %s (%d)", FRESULT_str(fr), fr);
+    printf("Recovered %lu blocks of %llu in %llu us, reading %lu blocks\n",
+           (unsigned long)end.blocks,
+           (unsigned long long)size / BIN_LOG_BLOCK_SIZE,
+           (unsigned long long)elapsed, (unsigned long)end.reads);
+
+    uint32_t count;
+    if (!read_back(path, &count)) return false;
+    if (count != expected)
+        FAIL("Found %lu records; expected %lu", (unsigned long)count,
+             (unsigned long)expected);
+
+    // Carry on where the log ended
+    fr = bin_log_open(&test_log, path, 0);
+    if (FR_OK != fr) FAIL("bin_log_open: %s (%d)", FRESULT_str(fr), fr);
+    if (!append(count, count + records / 2)) return false;
+    fr = bin_log_close(&test_log);
+    if (FR_OK != fr) FAIL("bin_log_close: %s (%d)", FRESULT_str(fr), fr);
+    if (!read_back(path, &count)) return false;
+    if (count != expected + records / 2)
+        FAIL("Found %lu records; expected %lu", (unsigned long)count,
+             (unsigned long)(expected + records / 2));
+
+    FILINFO fno;
+    fr = f_stat(path, &fno);
+    if (FR_OK != fr) FAIL("f_stat: %s (%d)", FRESULT_str(fr), fr);
+    printf("%lu records in %llu bytes (%.1f bytes/record)\n",
+           (unsigned long)count, (unsigned long long)fno.fsize,
+           (double)fno.fsize / count);
+    return true;
+}
+
+void bin_log_test(const char *path, uint32_t records) {
+    if (run(path, records)) printf("OK\n");
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,84 @@
+/* dir_lookup_benchmark.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Measure how the time to look up a name (f_stat) grows with the number of
+// files in the directory, to show the effect of the directory index
+// (FF_DIR_INDEX in ffconf.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff.h"
+
+#define LOOKUPS 100
+
+static void name(char *buf, size_t size, const char *dir, size_t i) {
+    snprintf(buf, size, "%s/data file %05zu.csv", dir, i);
+}
+
+// Average time for LOOKUPS f_stats of random names among the first n files
+static bool time_lookups(const char *dir, size_t n, uint64_t *us_p) {
+    char path[FF_LFN_BUF];
+    FILINFO fno;
+    uint64_t start = time_us_64();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        name(path, sizeof path, dir, rand() % n);
+        FRESULT fr = f_stat(path, &fno);
+        if (FR_OK != fr) {
+            printf("f_stat(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+            return false;
+        }
+    }
+    *us_p = (time_us_64() - start) / LOOKUPS;
+    return true;
+}
+
+void dir_lookup_benchmark(const char *dir, size_t max_files) {
+    FRESULT fr = f_mkdir(dir);
+    if (FR_OK != fr && FR_EXIST != fr) {
+        printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return;
+    }
+    char path[FF_LFN_BUF];
+    size_t n = 0;
+    printf("FF_DIR_INDEX=%d\n", FF_DIR_INDEX);
+    printf("%8s %14s %14s\n", "Files", "First us/stat", "Then us/stat");
+    for (size_t size = 64; size <= max_files; size *= 2) {
+        for (; n < size; ++n) {
+            name(path, sizeof path, dir, n);
+            FIL fil;
+            fr = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+            if (FR_OK != fr) {
+                printf("f_open(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+                goto cleanup;
+            }
+            f_close(&fil);
+        }
+        // Creating files drops the index, so the first round builds it again
+        uint64_t first, then;
+        if (!time_lookups(dir, n, &first) || !time_lookups(dir, n, &then))
+            goto cleanup;
+        printf("%8zu %14llu %14llu\n", n, first, then);
+    }
+cleanup:
+    while (n) {
+        name(path, sizeof path, dir, --n);
+        f_unlink(path);
+    }
+    f_unlink(dir);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,148 @@
+/* io_engine_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Write a file through the core 1 I/O engine while core 0 runs a "control
+// loop", then read it back and check it the same way. Reports how long the
+// loop on core 0 ever took, and the engine's queue statistics.
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff_stdio.h"
+#include "io_engine.h"
+
+#define BUFFERS 4
+#define BUF_SIZE 4096
+
+static uint8_t bufs[BUFFERS][BUF_SIZE];
+static io_request_t reqs[BUFFERS];
+
+static uint8_t pattern(size_t pos) { return (uint8_t)(pos * 7 + (pos >> 12)); }
+
+// Submit one request and wait for it (for open, sync and close)
+static bool run_one(io_request_t *req) {
+    if (!io_engine_submit(req)) return false;
+    while (!req->done) io_engine_poll();
+    if (req->error) printf("I/O engine request %d error: %s (%d)\n", req->op,
+                           strerror(req->error), req->error);
+    return !req->error;
+}
+
+// Stream size bytes through the engine, BUFFERS requests at a time.
+// Returns the longest time an iteration of the loop on core 0 took.
+static uint32_t stream(FF_FILE *file, io_op_t op, size_t size, bool *ok_p) {
+    size_t submitted = 0, completed = 0;
+    uint32_t max_loop_us = 0;
+    memset(reqs, 0, sizeof reqs);
+    for (size_t i = 0; i < BUFFERS; ++i) reqs[i].done = true;
+    while (completed < size && *ok_p) {
+        uint64_t loop_start = time_us_64();
+        io_engine_poll();
+        for (size_t i = 0; i < BUFFERS; ++i) {
+            io_request_t *req = &reqs[i];
+            if (!req->done) continue;
+            if (req->op == op && req->len) {  // Finished one of ours
+                if (req->error || req->result != req->len) {
+                    printf("%s error: %s\n", op == IO_WRITE ? "Write" : "Read",
+                           strerror(req->error));
+                    *ok_p = false;
+                }
+                if (IO_READ == op) {
+                    size_t pos = (size_t)req->context;
+                    for (size_t j = 0; j < req->result && *ok_p; ++j)
+                        if (bufs[i][j] != pattern(pos + j)) {
+                            printf("Data mismatch at %zu\n", pos + j);
+                            *ok_p = false;
+                        }
+                }
+                completed += req->len;
+                req->len = 0;
+            }
+            if (submitted < size) {
+                size_t n = size - submitted < BUF_SIZE ? size - submitted : BUF_SIZE;
+                if (IO_WRITE == op)
+                    for (size_t j = 0; j < n; ++j) bufs[i][j] = pattern(submitted + j);
+                memset(req, 0, sizeof *req);
+                req->op = op;
+                req->file = file;
+                req->buf = bufs[i];
+                req->len = n;
+                req->context = (void *)submitted;
+                if (io_engine_submit(req)) {
+                    submitted += n;
+                } else {
+                    printf("Can't submit\n");
+                    *ok_p = false;
+                }
+            }
+        }
+        // The rest of the control loop would go here
+        uint32_t loop_us = time_us_64() - loop_start;
+        if (loop_us > max_loop_us) max_loop_us = loop_us;
+    }
+    while (io_engine_in_flight()) io_engine_poll();
+    return max_loop_us;
+}
+
+static void print_stats(const char *what, size_t size, uint64_t elapsed_us,
+                        uint32_t max_loop_us) {
+    io_engine_stats_t s;
+    io_engine_get_stats(&s);
+    unsigned n = s.completed ? s.completed : 1;
+    printf("%s: %.1f KiB/s, longest core 0 loop iteration %lu us\n", what,
+           (double)size / 1024 / elapsed_us * 1e6, (unsigned long)max_loop_us);
+    printf("  requests %lu, errors %lu, rejected (queue full) %lu, max depth %lu\n",
+           (unsigned long)s.completed, (unsigned long)s.errors,
+           (unsigned long)s.rejected, (unsigned long)s.max_depth);
+    printf("  queued: avg %llu us, max %lu us; service: avg %llu us, max %lu us; "
+           "max latency %lu us\n",
+           s.total_wait_us / n, (unsigned long)s.max_wait_us,
+           s.total_service_us / n, (unsigned long)s.max_service_us,
+           (unsigned long)s.max_latency_us);
+}
+
+void io_engine_test(const char *path, size_t size) {
+    if (!io_engine_start()) {
+        printf("Can't start the I/O engine%s%s\n",
+               core1_owner() ? ": core 1 is in use by " : "",
+               core1_owner() ? core1_owner() : "");
+        return;
+    }
+    static const char *const modes[] = {"w", "r"};
+    static const io_op_t ops[] = {IO_WRITE, IO_READ};
+    bool ok = true;
+    for (size_t pass = 0; pass < 2 && ok; ++pass) {
+        io_request_t req = {.op = IO_OPEN, .path = path, .mode = modes[pass]};
+        if (!run_one(&req)) break;
+        FF_FILE *file = req.file;
+        io_engine_reset_stats();
+        uint64_t start = time_us_64();
+        uint32_t max_loop_us = stream(file, ops[pass], size, &ok);
+        if (IO_WRITE == ops[pass]) {
+            req = (io_request_t){.op = IO_SYNC, .file = file};
+            ok = run_one(&req) && ok;
+        }
+        uint64_t elapsed_us = time_us_64() - start;
+        print_stats(IO_WRITE == ops[pass] ? "Write" : "Read", size, elapsed_us,
+                    max_loop_us);
+        req = (io_request_t){.op = IO_CLOSE, .file = file};
+        ok = run_one(&req) && ok;
+    }
+    io_engine_stop();
+    printf("%s\n", ok ? "Data checked" : "FAILED");
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,94 @@
+/* logger_benchmark.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Drive the data logger from a timer interrupt: every period the ISR
+// appends a fixed size record (sequence number and timestamp) while the
+// main loop runs data_logger_task. Reports the record rate achieved, how
+// many records were dropped because the buffer filled, and how the writes
+// were batched.
+
+#include <stdio.h>
+//
+#include "pico/stdlib.h"
+//
+#include "data_logger.h"
+
+#define HEADER "Sequence,Microseconds\n"
+#define RECORD_LEN 18  // "ssssssss,tttttttt\n"
+
+static uint8_t buf[32 * 1024];
+static data_logger_t logger = {.suffix = ".log",
+                               .header = HEADER,
+                               .buf = buf,
+                               .buf_size = sizeof buf,
+                               .batch_size = 0,  // Default
+                               .sync_period_ms = 1000};
+static uint32_t seq;
+
+// Cheaper than printf in an ISR
+static void put_hex(char *p, uint32_t v) {
+    for (int i = 7; i >= 0; --i, v >>= 4) p[i] = "0123456789abcdef"[v & 0xf];
+}
+
+static bool timer_callback(repeating_timer_t *rt) {
+    char rec[RECORD_LEN];
+    put_hex(rec, seq++);
+    rec[8] = ',';
+    put_hex(rec + 9, time_us_32());
+    rec[17] = '\n';
+    data_logger_write(&logger, rec, sizeof rec);
+    return true;
+}
+
+void logger_benchmark(const char *dir, unsigned period_us, unsigned seconds) {
+    logger.dir = dir;
+    if (!data_logger_init(&logger)) return;
+    seq = 0;
+    printf("Logging a %d byte record every %u us for %u s...\n", RECORD_LEN,
+           period_us, seconds);
+    repeating_timer_t timer;
+    // Negative delay: period between starts of callbacks
+    if (!add_repeating_timer_us(-(int64_t)period_us, timer_callback, NULL,
+                                &timer)) {
+        printf("add_repeating_timer_us failed\n");
+        return;
+    }
+    uint64_t start = time_us_64();
+    absolute_time_t end = make_timeout_time_ms(seconds * 1000);
+    bool ok = true;
+    while (ok && !time_reached(end)) ok = data_logger_task(&logger);
+    cancel_repeating_timer(&timer);
+    if (!data_logger_close(&logger)) ok = false;
+    uint64_t elapsed = time_us_64() - start;
+
+    data_logger_stats_t stats;
+    data_logger_get_stats(&logger, &stats);
+    printf("Records: %lu (%.0f/s), dropped: %lu\n",
+           (unsigned long)stats.records, stats.records * 1E6 / elapsed,
+           (unsigned long)stats.dropped);
+    printf("Written: %llu bytes (%.1f KiB/s) in %lu writes to %lu file(s); "
+           "%lu syncs\n",
+           (unsigned long long)stats.bytes_written,
+           stats.bytes_written * 1E6 / elapsed / 1024,
+           (unsigned long)stats.writes, (unsigned long)stats.files,
+           (unsigned long)stats.syncs);
+    printf("Buffer high water mark: %lu of %zu bytes\n",
+           (unsigned long)stats.max_used, sizeof buf);
+    if (ok && stats.bytes_written != (uint64_t)stats.records * RECORD_LEN) {
+        printf("Bytes written doesn't match records logged!\n");
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+}
+
+/* [] END OF FILE */
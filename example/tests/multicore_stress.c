@@ -0,0 +1,153 @@
+/* multicore_stress.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Run file I/O on both cores at once (FF_FS_REENTRANT): each core writes,
+// reads back and checks, lists and deletes files in its own directory.
+// The two drives can be different cards or the same one.
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff.h"
+
+#define MAX_FILE_SIZE 3000
+
+typedef struct {
+    const char *drive;
+    unsigned core;
+    unsigned iterations;
+    unsigned errors;
+    uint8_t buf[MAX_FILE_SIZE];
+    uint8_t rbuf[MAX_FILE_SIZE];
+} job_t;
+
+static job_t jobs[2];
+static volatile bool core1_busy;
+
+#define FAIL(job, fmt, args...)                               \
+    {                                                         \
+        printf("core %u: " fmt, (job)->core, ##args);         \
+        ++(job)->errors;                                      \
+    }
+
+static uint8_t pattern(unsigned seed, size_t i) {
+    return (uint8_t)(seed * 31 + i * 7 + (i >> 8));
+}
+
+static void stress(job_t *job) {
+    char dir[16], path[64];
+    snprintf(dir, sizeof dir, "%s/mcs%u", job->drive, job->core);
+    FRESULT fr = f_mkdir(dir);
+    if (FR_OK != fr && FR_EXIST != fr) {
+        FAIL(job, "f_mkdir(%s) error: %s (%d)\n", dir, FRESULT_str(fr), fr);
+        return;
+    }
+    for (unsigned i = 0; i < job->iterations; ++i) {
+        unsigned seed = job->core * 100000 + i;
+        size_t len = (seed * 2654435761u) % MAX_FILE_SIZE;
+        for (size_t k = 0; k < len; ++k) job->buf[k] = pattern(seed, k);
+        snprintf(path, sizeof path, "%s/file with a long name %u.dat", dir, i % 37);
+
+        FIL fil;
+        UINT n;
+        fr = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+        if (FR_OK != fr) {
+            FAIL(job, "f_open(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+            continue;
+        }
+        // Several writes, so that the other core gets in between
+        for (size_t off = 0; off < len; off += n) {
+            UINT chunk = len - off > 700 ? 700 : len - off;
+            fr = f_write(&fil, job->buf + off, chunk, &n);
+            if (FR_OK != fr || n != chunk) {
+                FAIL(job, "f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+                break;
+            }
+        }
+        fr = f_close(&fil);
+        if (FR_OK != fr) FAIL(job, "f_close error: %s (%d)\n", FRESULT_str(fr), fr);
+
+        fr = f_open(&fil, path, FA_READ);
+        if (FR_OK != fr) {
+            FAIL(job, "f_open(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+            continue;
+        }
+        fr = f_read(&fil, job->rbuf, sizeof job->rbuf, &n);
+        f_close(&fil);
+        if (FR_OK != fr || n != len || memcmp(job->rbuf, job->buf, len))
+            FAIL(job, "%s: read back %u of %u bytes, %s\n", path, n, (unsigned)len,
+                  FR_OK != fr ? FRESULT_str(fr) : "mismatch");
+
+        if (4 == i % 5) {
+            DIR dj;
+            FILINFO fno;
+            unsigned count = 0;
+            fr = f_opendir(&dj, dir);
+            while (FR_OK == fr && FR_OK == (fr = f_readdir(&dj, &fno)) && fno.fname[0])
+                ++count;
+            f_closedir(&dj);
+            if (FR_OK != fr || !count)
+                FAIL(job, "f_readdir(%s) error: %s (%d)\n", dir, FRESULT_str(fr), fr);
+        }
+        if (6 == i % 7) {
+            fr = f_unlink(path);
+            if (FR_OK != fr)
+                FAIL(job, "f_unlink(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+        }
+    }
+    FILINFO fno;
+    snprintf(path, sizeof path, "%s", dir);
+    fr = delete_node(path, sizeof path, &fno);
+    if (FR_OK != fr) FAIL(job, "delete_node(%s) error: %s (%d)\n", dir, FRESULT_str(fr), fr);
+}
+
+static void core1_entry() {
+    stress(&jobs[1]);
+    __mem_fence_release();
+    core1_busy = false;
+}
+
+void multicore_stress_test(const char *drive0, const char *drive1, unsigned iterations) {
+    jobs[0].drive = drive0;
+    jobs[1].drive = drive1;
+    for (unsigned i = 0; i < 2; ++i) {
+        jobs[i].core = i;
+        jobs[i].iterations = iterations;
+        jobs[i].errors = 0;
+    }
+    if (!core1_claim("multicore_stress_test")) {
+        printf("Core 1 is in use by %s\n", core1_owner());
+        return;
+    }
+    uint64_t start = time_us_64();
+    core1_busy = true;
+    multicore_reset_core1();
+    multicore_launch_core1(core1_entry);
+    stress(&jobs[0]);
+    uint64_t core0_us = time_us_64() - start;
+    while (core1_busy) tight_loop_contents();
+    __mem_fence_acquire();
+    core1_release();
+    uint64_t total_us = time_us_64() - start;
+    printf("core 0 (%s): %u errors, %llu ms\n", drive0, jobs[0].errors, core0_us / 1000);
+    printf("core 1 (%s): %u errors\n", drive1, jobs[1].errors);
+    printf("Both done in %llu ms: %s\n", total_us / 1000,
+           jobs[0].errors + jobs[1].errors ? "FAILED" : "passed");
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,91 @@
+/* small_file_benchmark.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Create and delete many small files: a workload that is mostly FAT and
+// directory traffic, to exercise the sector cache (DISK_CACHE_SECTORS).
+
+#include <stdio.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff.h"
+#include "sd_card.h"
+
+static void print_cache_stats(const char *phase, uint64_t elapsed_us,
+                              size_t count, const sd_card_stats_t *before,
+                              const sd_card_stats_t *after) {
+    printf("%-8s %6.2f ms/file", phase, elapsed_us / 1000.0 / count);
+    if (before && after)
+        printf(", sector cache hits: %lu, misses: %lu, write-backs: %lu",
+               (unsigned long)(after->cache_hits - before->cache_hits),
+               (unsigned long)(after->cache_misses - before->cache_misses),
+               (unsigned long)(after->cache_write_backs -
+                               before->cache_write_backs));
+    printf("\n");
+}
+
+// pSD (optional): the card holding dir, for its cache counters
+void small_file_benchmark(sd_card_t *pSD, const char *dir, size_t count) {
+    FRESULT fr = f_mkdir(dir);
+    if (FR_OK != fr && FR_EXIST != fr) {
+        printf("f_mkdir error: %s (%d)\n", FRESULT_str(fr), fr);
+        return;
+    }
+    sd_card_stats_t before, after;
+    char path[FF_LFN_BUF];
+
+    printf("Creating %zu files in %s\n", count, dir);
+    if (pSD) before = pSD->stats;
+    uint64_t start = time_us_64();
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(path, sizeof path, "%s/file%04zu.txt", dir, i);
+        FIL fil;
+        fr = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+        if (FR_OK != fr) {
+            printf("f_open(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+            return;
+        }
+        if (f_printf(&fil, "Small file number %u\n", (unsigned)i) < 0) {
+            printf("f_printf failed\n");
+            f_close(&fil);
+            return;
+        }
+        fr = f_close(&fil);
+        if (FR_OK != fr) {
+            printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
+            return;
+        }
+    }
+    if (pSD) after = pSD->stats;
+    print_cache_stats("Create:", time_us_64() - start, count,
+                      pSD ? &before : NULL, pSD ? &after : NULL);
+
+    if (pSD) before = pSD->stats;
+    start = time_us_64();
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(path, sizeof path, "%s/file%04zu.txt", dir, i);
+        fr = f_unlink(path);
+        if (FR_OK != fr) {
+            printf("f_unlink(%s) error: %s (%d)\n", path, FRESULT_str(fr), fr);
+            return;
+        }
+    }
+    fr = f_unlink(dir);
+    if (FR_OK != fr) printf("f_unlink(%s) error: %s (%d)\n", dir, FRESULT_str(fr), fr);
+    if (pSD) after = pSD->stats;
+    print_cache_stats("Delete:", time_us_64() - start, count,
+                      pSD ? &before : NULL, pSD ? &after : NULL);
+}
+
+/* [] END OF FILE */
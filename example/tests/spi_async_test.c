@@ -0,0 +1,108 @@
+/* spi_async_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Exercise spi_transfer_async on an SD card's SPI, with the card deselected
+// so that it ignores the traffic: fill the queue with transfers that have
+// completion callbacks, and check that a full queue is refused, that the
+// callbacks come in order, that the DMA IRQ handler had already started the
+// next transfer when each callback ran, and that the blocking spi_transfer
+// still works afterwards.
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "sd_card.h"
+#include "spi.h"
+
+#define JOB_SIZE 4096  // Long enough that the queue can be filled
+
+static uint8_t tx_buf[JOB_SIZE];
+static spi_t *test_spi_p;
+static volatile size_t done_count;
+static size_t done_order[SPI_XFER_QUEUE_DEPTH];
+static bool next_on_wire[SPI_XFER_QUEUE_DEPTH];
+static uint64_t done_us[SPI_XFER_QUEUE_DEPTH];
+
+// Called from the DMA IRQ handler
+static void on_done(void *cb_arg) {
+    size_t n = done_count;
+    if (n < SPI_XFER_QUEUE_DEPTH) {
+        done_order[n] = (size_t)cb_arg;
+        next_on_wire[n] = dma_channel_is_busy(test_spi_p->rx_dma);
+        done_us[n] = time_us_64();
+    }
+    done_count = n + 1;
+}
+
+#define FAIL(fmt, args...)                   \
+    {                                        \
+        printf("FAILED: " fmt "\n", ##args); \
+        return false;                        \
+    }
+
+static bool run(spi_t *spi_p) {
+    test_spi_p = spi_p;
+    done_count = 0;
+    memset(tx_buf, SPI_FILL_CHAR, sizeof tx_buf);
+
+    uint64_t start = time_us_64();
+    for (size_t i = 0; i < SPI_XFER_QUEUE_DEPTH; ++i)
+        if (!spi_transfer_async(spi_p, tx_buf, NULL, JOB_SIZE, on_done,
+                                (void *)i))
+            FAIL("spi_transfer_async refused transfer %zu", i);
+    if (spi_transfer_async(spi_p, tx_buf, NULL, JOB_SIZE, on_done, NULL))
+        FAIL("spi_transfer_async accepted more than %d transfers",
+             SPI_XFER_QUEUE_DEPTH);
+    if (!spi_transfer_wait_idle(spi_p, 1000))
+        FAIL("spi_transfer_wait_idle timed out");
+    uint64_t elapsed = time_us_64() - start;
+
+    if (SPI_XFER_QUEUE_DEPTH != done_count)
+        FAIL("%zu callbacks for %d transfers", done_count,
+             SPI_XFER_QUEUE_DEPTH);
+    for (size_t i = 0; i < SPI_XFER_QUEUE_DEPTH; ++i) {
+        if (done_order[i] != i)
+            FAIL("Callback %zu was for transfer %zu", i, done_order[i]);
+        bool last = SPI_XFER_QUEUE_DEPTH - 1 == i;
+        if (next_on_wire[i] == last)
+            FAIL("Transfer %zu: next transfer %s when the callback ran", i,
+                 last ? "running" : "not started");
+    }
+    printf("%d transfers of %d bytes in %llu us (%.0f KB/s); "
+           "callbacks at", SPI_XFER_QUEUE_DEPTH, JOB_SIZE, elapsed,
+           (double)SPI_XFER_QUEUE_DEPTH * JOB_SIZE / elapsed * 1000);
+    for (size_t i = 0; i < SPI_XFER_QUEUE_DEPTH; ++i)
+        printf(" %llu", done_us[i] - start);
+    printf(" us\n");
+
+    if (!spi_transfer(spi_p, tx_buf, NULL, JOB_SIZE))
+        FAIL("spi_transfer after the asynchronous transfers");
+    return true;
+}
+
+void spi_async_test(sd_card_t *pSD) {
+    if (!pSD->spi->initialized) {
+        printf("SPI is not initialized; mount the drive first\n");
+        return;
+    }
+    // The card is deselected except during a command, and holding the
+    // SPI keeps it that way.
+    spi_lock(pSD->spi);
+    bool ok = run(pSD->spi);
+    spi_unlock(pSD->spi);
+    if (ok) printf("OK\n");
+}
+
+/* [] END OF FILE */
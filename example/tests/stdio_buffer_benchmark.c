@@ -0,0 +1,100 @@
+/* stdio_buffer_benchmark.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Time character at a time I/O (ff_fputc, ff_fgetc, ff_fgets) on streams
+// with each kind of buffering set by ff_setvbuf, checking what is read.
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "ff_stdio.h"
+
+#define LINE_LEN 64  // Including the '\n'
+
+static char buffer[4096];
+
+// Character at file offset i
+static char text(size_t i) {
+    return LINE_LEN - 1 == i % LINE_LEN ? '\n' : 'A' + i / LINE_LEN % 26;
+}
+
+static void report(const char *what, uint64_t elapsed_us, size_t size) {
+    printf("  %-8s %8.1f KiB/s\n", what, size * 1E6 / elapsed_us / 1024);
+}
+
+static bool run(const char *path, size_t size, const char *name, int mode,
+                size_t bufsize) {
+    printf("%s:\n", name);
+    FF_FILE *file = ff_fopen(path, "w");
+    if (!file || ff_setvbuf(file, buffer, mode, bufsize)) {
+        printf("ff_fopen or ff_setvbuf failed: %s (%d)\n", strerror(errno),
+               errno);
+        if (file) ff_fclose(file);
+        return false;
+    }
+    uint64_t start = time_us_64();
+    for (size_t i = 0; i < size; ++i) {
+        if (ff_fputc(text(i), file) != text(i)) {
+            printf("ff_fputc failed: %s (%d)\n", strerror(errno), errno);
+            ff_fclose(file);
+            return false;
+        }
+    }
+    if (ff_fclose(file)) {
+        printf("ff_fclose failed: %s (%d)\n", strerror(errno), errno);
+        return false;
+    }
+    report("fputc", time_us_64() - start, size);
+
+    file = ff_fopen(path, "r");
+    if (!file || ff_setvbuf(file, buffer, mode, bufsize)) {
+        printf("ff_fopen or ff_setvbuf failed: %s (%d)\n", strerror(errno),
+               errno);
+        if (file) ff_fclose(file);
+        return false;
+    }
+    bool ok = true;
+    start = time_us_64();
+    for (size_t i = 0; ok && i < size; ++i) ok = ff_fgetc(file) == text(i);
+    if (ok) ok = FF_EOF == ff_fgetc(file);
+    if (ok) report("fgetc", time_us_64() - start, size);
+
+    ff_rewind(file);
+    char line[LINE_LEN + 1];
+    size_t pos = 0;
+    start = time_us_64();
+    while (ok && ff_fgets(line, sizeof line, file)) {
+        size_t len = strlen(line);
+        for (size_t i = 0; ok && i < len; ++i) ok = line[i] == text(pos + i);
+        pos += len;
+    }
+    if (ok) ok = pos == size;
+    if (ok) report("fgets", time_us_64() - start, size);
+    ff_fclose(file);
+    if (!ok) printf("Read back doesn't match!\n");
+    return ok;
+}
+
+void stdio_buffer_benchmark(const char *path, size_t size) {
+    bool ok = run(path, size, "Unbuffered", FF_IONBF, 0) &&
+              run(path, size, "Line buffered, 512 bytes", FF_IOLBF, 512) &&
+              run(path, size, "Fully buffered, 512 bytes", FF_IOFBF, 512) &&
+              run(path, size, "Fully buffered, 4096 bytes", FF_IOFBF,
+                  sizeof buffer);
+    ff_remove(path);
+    printf("%s\n", ok ? "OK" : "FAILED");
+}
+
+/* [] END OF FILE */
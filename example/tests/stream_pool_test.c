@@ -0,0 +1,119 @@
+/* stream_pool_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Open more streams at once than ff_stdio keeps in its pool, time
+// ff_fopen/ff_fclose, and report how the pools were used, including the
+// pool of FatFs LFN working buffers behind ff_memalloc.
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff_stdio.h"
+
+#define FILES 8
+#define ROUNDS 50
+
+typedef struct {
+    uint32_t min, max;
+    uint64_t total;
+    uint32_t count;
+} timing_t;
+
+static void time_it(timing_t *t, uint32_t elapsed) {
+    if (!t->count || elapsed < t->min) t->min = elapsed;
+    if (elapsed > t->max) t->max = elapsed;
+    t->total += elapsed;
+    ++t->count;
+}
+
+static void report_time(const char *name, const timing_t *t) {
+    if (t->count)
+        printf("%-10s min %5lu us, max %5lu us, mean %5lu us\n", name,
+               (unsigned long)t->min, (unsigned long)t->max,
+               (unsigned long)(t->total / t->count));
+}
+
+static void report_pool(const char *name, const obj_pool_stats_t *s) {
+    printf("%-18s capacity %zu, in use %zu, high water %zu\n", name,
+           s->capacity, s->in_use, s->high_water);
+    printf("%-18s %lu allocations from the pool, %lu from the heap\n", "",
+           (unsigned long)s->allocs, (unsigned long)s->exhausted);
+}
+
+void stream_pool_test(const char *dir) {
+    char path[FILES][64];
+    for (size_t i = 0; i < FILES; ++i)
+        snprintf(path[i], sizeof path[i], "%s/spt%zu.txt", dir, i);
+    timing_t open_time = {0}, close_time = {0};
+    bool ok = true;
+    for (int round = 0; ok && round < ROUNDS; ++round) {
+        FF_FILE *files[FILES] = {0};
+        for (size_t i = 0; ok && i < FILES; ++i) {
+            uint32_t start = time_us_32();
+            files[i] = ff_fopen(path[i], "a");
+            time_it(&open_time, time_us_32() - start);
+            if (!files[i]) {
+                printf("ff_fopen(%s) failed: %s (%d)\n", path[i],
+                       strerror(errno), errno);
+                ok = false;
+            } else if (EOF == ff_fputc('a' + round % 26, files[i])) {
+                printf("ff_fputc failed: %s (%d)\n", strerror(errno), errno);
+                ok = false;
+            }
+        }
+        for (size_t i = 0; i < FILES; ++i) {
+            if (!files[i]) continue;
+            uint32_t start = time_us_32();
+            if (ff_fclose(files[i])) {
+                printf("ff_fclose failed: %s (%d)\n", strerror(errno), errno);
+                ok = false;
+            }
+            time_it(&close_time, time_us_32() - start);
+        }
+        FF_FindData_t find_data;
+        memset(&find_data, 0, sizeof find_data);
+        if (ok && ff_findfirst(dir, &find_data)) {
+            printf("ff_findfirst(%s) failed: %s (%d)\n", dir, strerror(errno),
+                   errno);
+            ok = false;
+        }
+        if (ok) f_closedir(&find_data.dir);
+    }
+    for (size_t i = 0; ok && i < FILES; ++i) {
+        FF_Stat_t stat;
+        if (ff_stat(path[i], &stat) || stat.st_size != ROUNDS) {
+            printf("%s has the wrong length\n", path[i]);
+            ok = false;
+        }
+    }
+    for (size_t i = 0; i < FILES; ++i) ff_remove(path[i]);
+
+    report_time("ff_fopen", &open_time);
+    report_time("ff_fclose", &close_time);
+    obj_pool_stats_t streams, find_bufs, lfn_bufs;
+    ff_stdio_get_pool_stats(&streams, &find_bufs);
+    ff_memalloc_get_stats(&lfn_bufs);
+    report_pool("Stream pool:", &streams);
+    report_pool("ff_findfirst pool:", &find_bufs);
+    report_pool("LFN buffer pool:", &lfn_bufs);
+    if (ok && streams.in_use) {
+        printf("Streams still in use after closing!\n");
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+}
+
+/* [] END OF FILE */